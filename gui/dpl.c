@@ -73,6 +73,12 @@ typedef struct {
 	float    _min[HISTLEN];
 	float    _max[HISTLEN];
 	uint32_t _hist;
+	uint32_t _hseq; // sequence number of the next entry
+
+	/* DSP load, time per sample; < 0: not available */
+	float dsp_mean;
+	float dsp_peak;
+	int   dsp_unit; // DSPUnit
 
 	RobTkDial* spn_ctrl[3];
 	RobTkLbl*  lbl_ctrl[3];
@@ -630,6 +636,22 @@ m0_expose_event (RobWidget* handle, cairo_t* cr, cairo_rectangle_t* ev)
 		g_object_unref (pl);
 	}
 
+	/* DSP load, bottom left of the history */
+	if (ui->dsp_mean >= 0) {
+		int          tw, th;
+		char         txt[64];
+		PangoLayout* pl = pango_cairo_create_layout (cr);
+		pango_layout_set_font_description (pl, ui->font[0]);
+		snprintf (txt, 64, "DSP %.1f avg, %.1f peak %s/spl", ui->dsp_mean, ui->dsp_peak,
+		          ui->dsp_unit == DSP_UNIT_TSC ? "ref.cycles" : "ns");
+		CairoSetSouerceRGBA (c_g30);
+		pango_layout_set_text (pl, txt, -1);
+		pango_layout_get_pixel_size (pl, &tw, &th);
+		cairo_move_to (cr, 10, YPOS (60) - th);
+		pango_cairo_show_layout (cr, pl);
+		g_object_unref (pl);
+	}
+
 	return TRUE;
 }
 
@@ -845,7 +867,7 @@ instantiate (
 		return NULL;
 	}
 
-	if (strcmp (plugin_uri, RTK_URI "mono") && strcmp (plugin_uri, RTK_URI "stereo")) {
+	if (strncmp (plugin_uri, RTK_URI, strlen (RTK_URI))) {
 		free (ui);
 		return NULL;
 	}
@@ -868,6 +890,9 @@ instantiate (
 	ui->write           = write_function;
 	ui->controller      = controller;
 	ui->disable_signals = true;
+	ui->dsp_mean        = -1;
+	ui->dsp_peak        = -1;
+	ui->dsp_unit        = DSP_UNIT_NS;
 
 	map_plim_uris (ui->map, &ui->uris);
 	lv2_atom_forge_init (&ui->forge, ui->map);
@@ -915,8 +940,10 @@ port_event (LV2UI_Handle handle,
 			const LV2_Atom* a0 = NULL;
 			const LV2_Atom* a1 = NULL;
 			const LV2_Atom* a2 = NULL;
-			if (3 == lv2_atom_object_get (obj, ui->uris.position, &a0, ui->uris.minvals, &a1, ui->uris.maxvals, &a2, NULL) && a0 && a1 && a2 && a0->type == ui->uris.atom_Int && a1->type == ui->uris.atom_Vector && a2->type == ui->uris.atom_Vector) {
+			const LV2_Atom* a3 = NULL;
+			if (4 == lv2_atom_object_get (obj, ui->uris.position, &a0, ui->uris.minvals, &a1, ui->uris.maxvals, &a2, ui->uris.sequence, &a3, NULL) && a0 && a1 && a2 && a3 && a0->type == ui->uris.atom_Int && a1->type == ui->uris.atom_Vector && a2->type == ui->uris.atom_Vector && a3->type == ui->uris.atom_Int) {
 				ui->_hist = ((LV2_Atom_Int*)a0)->body;
+				ui->_hseq = ((LV2_Atom_Int*)a3)->body;
 
 				LV2_Atom_Vector* mins = (LV2_Atom_Vector*)LV2_ATOM_BODY (a1);
 				assert (mins->atom.type == ui->uris.atom_Float);
@@ -930,6 +957,48 @@ port_event (LV2UI_Handle handle,
 				memcpy (ui->_max, (float*)LV2_ATOM_BODY (&maxs->atom), sizeof (float) * HISTLEN);
 				queue_draw (ui->m0);
 			}
+		} else if (obj->body.otype == ui->uris.histdelta) {
+			/* new entries only, since the last history or histdelta */
+			const LV2_Atom* a0 = NULL;
+			const LV2_Atom* a1 = NULL;
+			const LV2_Atom* a2 = NULL;
+			if (3 == lv2_atom_object_get (obj, ui->uris.sequence, &a0, ui->uris.minvals, &a1, ui->uris.maxvals, &a2, NULL) && a0 && a1 && a2 && a0->type == ui->uris.atom_Int && a1->type == ui->uris.atom_Vector && a2->type == ui->uris.atom_Vector) {
+				LV2_Atom_Vector* mins = (LV2_Atom_Vector*)LV2_ATOM_BODY (a1);
+				LV2_Atom_Vector* maxs = (LV2_Atom_Vector*)LV2_ATOM_BODY (a2);
+				if (mins->atom.type != ui->uris.atom_Float || maxs->atom.type != ui->uris.atom_Float) {
+					return;
+				}
+				const uint32_t n = (a1->size - sizeof (LV2_Atom_Vector_Body)) / mins->atom.size;
+				if (n > HISTLEN || n != (a2->size - sizeof (LV2_Atom_Vector_Body)) / maxs->atom.size) {
+					return;
+				}
+
+				if ((uint32_t)((LV2_Atom_Int*)a0)->body != ui->_hseq) {
+					/* missed a message, request the complete history */
+					ui_enable (ui);
+					return;
+				}
+
+				const float* vmin = (const float*)LV2_ATOM_BODY (&mins->atom);
+				const float* vmax = (const float*)LV2_ATOM_BODY (&maxs->atom);
+				for (uint32_t i = 0; i < n; ++i) {
+					ui->_min[ui->_hist] = vmin[i];
+					ui->_max[ui->_hist] = vmax[i];
+					ui->_hist           = (ui->_hist + 1) % HISTLEN;
+				}
+				ui->_hseq += n;
+				queue_draw (ui->m0);
+			}
+		} else if (obj->body.otype == ui->uris.dspload) {
+			const LV2_Atom* a0 = NULL;
+			const LV2_Atom* a1 = NULL;
+			const LV2_Atom* a2 = NULL;
+			if (3 == lv2_atom_object_get (obj, ui->uris.dsp_mean, &a0, ui->uris.dsp_peak, &a1, ui->uris.dsp_unit, &a2, NULL) && a0 && a1 && a2 && a0->type == ui->uris.atom_Float && a1->type == ui->uris.atom_Float && a2->type == ui->uris.atom_Int) {
+				ui->dsp_mean = ((LV2_Atom_Float*)a0)->body;
+				ui->dsp_peak = ((LV2_Atom_Float*)a1)->body;
+				ui->dsp_unit = ((LV2_Atom_Int*)a2)->body;
+				queue_draw (ui->m0);
+			}
 		}
 		return;
 	}
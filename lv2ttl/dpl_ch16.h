@@ -0,0 +1,72 @@
+// generated by lv2ttl2c from
+// http://gareus.org/oss/lv2/dpl#ch16
+
+extern const LV2_Descriptor* lv2_descriptor(uint32_t index);
+extern const LV2UI_Descriptor* lv2ui_descriptor(uint32_t index);
+
+static const RtkLv2Description _plugin_ch16 = {
+	&lv2_descriptor,
+	&lv2ui_descriptor
+	, 5 // uint32_t dsp_descriptor_id
+	, 0 // uint32_t gui_descriptor_id
+	, "x42-dpl - Digital Peak Limiter 16 Channels" // const char *plugin_human_id
+	, (const struct LV2Port[43])
+	{
+		{ "control", ATOM_IN, nan, nan, nan, "UI to plugin communication"},
+		{ "notify", ATOM_OUT, nan, nan, nan, "Plugin to GUI communication"},
+		{ "enable", CONTROL_IN, 1.000000, 0.000000, 1.000000, "Enable"},
+		{ "gain", CONTROL_IN, 0.000000, -10.000000, 30.000000, "Input Gain"},
+		{ "threshold", CONTROL_IN, -1.000000, -10.000000, 0.000000, "Threshold"},
+		{ "release", CONTROL_IN, 0.010000, 0.001000, 1.000000, "Release Time"},
+		{ "truepeak", CONTROL_IN, 0.000000, 0.000000, 1.000000, "True Peak"},
+		{ "level", CONTROL_OUT, nan, -10.000000, 20.000000, "Signal Level"},
+		{ "latency", CONTROL_OUT, nan, 0.000000, 4096.000000, "Signal Latency"},
+		{ "in1", AUDIO_IN, nan, nan, nan, "In 1"},
+		{ "out1", AUDIO_OUT, nan, nan, nan, "Out 1"},
+		{ "in2", AUDIO_IN, nan, nan, nan, "In 2"},
+		{ "out2", AUDIO_OUT, nan, nan, nan, "Out 2"},
+		{ "in3", AUDIO_IN, nan, nan, nan, "In 3"},
+		{ "out3", AUDIO_OUT, nan, nan, nan, "Out 3"},
+		{ "in4", AUDIO_IN, nan, nan, nan, "In 4"},
+		{ "out4", AUDIO_OUT, nan, nan, nan, "Out 4"},
+		{ "in5", AUDIO_IN, nan, nan, nan, "In 5"},
+		{ "out5", AUDIO_OUT, nan, nan, nan, "Out 5"},
+		{ "in6", AUDIO_IN, nan, nan, nan, "In 6"},
+		{ "out6", AUDIO_OUT, nan, nan, nan, "Out 6"},
+		{ "in7", AUDIO_IN, nan, nan, nan, "In 7"},
+		{ "out7", AUDIO_OUT, nan, nan, nan, "Out 7"},
+		{ "in8", AUDIO_IN, nan, nan, nan, "In 8"},
+		{ "out8", AUDIO_OUT, nan, nan, nan, "Out 8"},
+		{ "in9", AUDIO_IN, nan, nan, nan, "In 9"},
+		{ "out9", AUDIO_OUT, nan, nan, nan, "Out 9"},
+		{ "in10", AUDIO_IN, nan, nan, nan, "In 10"},
+		{ "out10", AUDIO_OUT, nan, nan, nan, "Out 10"},
+		{ "in11", AUDIO_IN, nan, nan, nan, "In 11"},
+		{ "out11", AUDIO_OUT, nan, nan, nan, "Out 11"},
+		{ "in12", AUDIO_IN, nan, nan, nan, "In 12"},
+		{ "out12", AUDIO_OUT, nan, nan, nan, "Out 12"},
+		{ "in13", AUDIO_IN, nan, nan, nan, "In 13"},
+		{ "out13", AUDIO_OUT, nan, nan, nan, "Out 13"},
+		{ "in14", AUDIO_IN, nan, nan, nan, "In 14"},
+		{ "out14", AUDIO_OUT, nan, nan, nan, "Out 14"},
+		{ "in15", AUDIO_IN, nan, nan, nan, "In 15"},
+		{ "out15", AUDIO_OUT, nan, nan, nan, "Out 15"},
+		{ "in16", AUDIO_IN, nan, nan, nan, "In 16"},
+		{ "out16", AUDIO_OUT, nan, nan, nan, "Out 16"},
+		{ "lookahead", CONTROL_IN, 1.200000, 0.250000, 10.000000, "Look-ahead"},
+		{ "dspload", CONTROL_OUT, nan, 0.000000, 1000.000000, "DSP Load"},
+	}
+	, 43 // uint32_t nports_total
+	, 16 // uint32_t nports_audio_in
+	, 16 // uint32_t nports_audio_out
+	, 0 // uint32_t nports_midi_in
+	, 0 // uint32_t nports_midi_out
+	, 1 // uint32_t nports_atom_in
+	, 1 // uint32_t nports_atom_out
+	, 9 // uint32_t nports_ctrl
+	, 6 // uint32_t nports_ctrl_in
+	, 3 // uint32_t nports_ctrl_out
+	, 1048928 // uint32_t min_atom_bufsiz
+	, false // bool send_time_info
+	, 8 // uint32_t latency_ctrl_port
+};
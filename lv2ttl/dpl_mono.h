@@ -10,7 +10,7 @@ static const RtkLv2Description _plugin_mono = {
 	, 0 // uint32_t dsp_descriptor_id
 	, 0 // uint32_t gui_descriptor_id
 	, "x42-dpl - Digital Peak Limiter Mono" // const char *plugin_human_id
-	, (const struct LV2Port[11])
+	, (const struct LV2Port[13])
 	{
 		{ "control", ATOM_IN, nan, nan, nan, "UI to plugin communication"},
 		{ "notify", ATOM_OUT, nan, nan, nan, "Plugin to GUI communication"},
@@ -20,20 +20,22 @@ static const RtkLv2Description _plugin_mono = {
 		{ "release", CONTROL_IN, 0.010000, 0.001000, 1.000000, "Release Time"},
 		{ "truepeak", CONTROL_IN, 0.000000, 0.000000, 1.000000, "True Peak"},
 		{ "level", CONTROL_OUT, nan, -10.000000, 20.000000, "Signal Level"},
-		{ "latency", CONTROL_OUT, nan, 0.000000, 1024.000000, "Signal Latency"},
+		{ "latency", CONTROL_OUT, nan, 0.000000, 4096.000000, "Signal Latency"},
 		{ "in", AUDIO_IN, nan, nan, nan, "In"},
 		{ "out", AUDIO_OUT, nan, nan, nan, "Out"},
+		{ "lookahead", CONTROL_IN, 1.200000, 0.250000, 10.000000, "Look-ahead"},
+		{ "dspload", CONTROL_OUT, nan, 0.000000, 1000.000000, "DSP Load"},
 	}
-	, 11 // uint32_t nports_total
+	, 13 // uint32_t nports_total
 	, 1 // uint32_t nports_audio_in
 	, 1 // uint32_t nports_audio_out
 	, 0 // uint32_t nports_midi_in
 	, 0 // uint32_t nports_midi_out
 	, 1 // uint32_t nports_atom_in
 	, 1 // uint32_t nports_atom_out
-	, 7 // uint32_t nports_ctrl
-	, 5 // uint32_t nports_ctrl_in
-	, 2 // uint32_t nports_ctrl_out
+	, 9 // uint32_t nports_ctrl
+	, 6 // uint32_t nports_ctrl_in
+	, 3 // uint32_t nports_ctrl_out
 	, 65888 // uint32_t min_atom_bufsiz
 	, false // bool send_time_info
 	, 8 // uint32_t latency_ctrl_port
@@ -10,7 +10,7 @@ static const RtkLv2Description _plugin_stereo = {
 	, 1 // uint32_t dsp_descriptor_id
 	, 0 // uint32_t gui_descriptor_id
 	, "x42-dpl - Digital Peak Limiter Stereo" // const char *plugin_human_id
-	, (const struct LV2Port[13])
+	, (const struct LV2Port[15])
 	{
 		{ "control", ATOM_IN, nan, nan, nan, "UI to plugin communication"},
 		{ "notify", ATOM_OUT, nan, nan, nan, "Plugin to GUI communication"},
@@ -20,22 +20,24 @@ static const RtkLv2Description _plugin_stereo = {
 		{ "release", CONTROL_IN, 0.010000, 0.001000, 1.000000, "Release Time"},
 		{ "truepeak", CONTROL_IN, 0.000000, 0.000000, 1.000000, "True Peak"},
 		{ "level", CONTROL_OUT, nan, -10.000000, 20.000000, "Signal Level"},
-		{ "latency", CONTROL_OUT, nan, 0.000000, 1024.000000, "Signal Latency"},
+		{ "latency", CONTROL_OUT, nan, 0.000000, 4096.000000, "Signal Latency"},
 		{ "inL", AUDIO_IN, nan, nan, nan, "In Left"},
 		{ "outL", AUDIO_OUT, nan, nan, nan, "Out Left"},
 		{ "inR", AUDIO_IN, nan, nan, nan, "In Right"},
 		{ "outR", AUDIO_OUT, nan, nan, nan, "Out Right"},
+		{ "lookahead", CONTROL_IN, 1.200000, 0.250000, 10.000000, "Look-ahead"},
+		{ "dspload", CONTROL_OUT, nan, 0.000000, 1000.000000, "DSP Load"},
 	}
-	, 13 // uint32_t nports_total
+	, 15 // uint32_t nports_total
 	, 2 // uint32_t nports_audio_in
 	, 2 // uint32_t nports_audio_out
 	, 0 // uint32_t nports_midi_in
 	, 0 // uint32_t nports_midi_out
 	, 1 // uint32_t nports_atom_in
 	, 1 // uint32_t nports_atom_out
-	, 7 // uint32_t nports_ctrl
-	, 5 // uint32_t nports_ctrl_in
-	, 2 // uint32_t nports_ctrl_out
+	, 9 // uint32_t nports_ctrl
+	, 6 // uint32_t nports_ctrl_in
+	, 3 // uint32_t nports_ctrl_out
 	, 131424 // uint32_t min_atom_bufsiz
 	, false // bool send_time_info
 	, 8 // uint32_t latency_ctrl_port
@@ -4,9 +4,17 @@
 
 #include "lv2ttl/dpl_mono.h"
 #include "lv2ttl/dpl_stereo.h"
+#include "lv2ttl/dpl_ch4.h"
+#include "lv2ttl/dpl_ch6.h"
+#include "lv2ttl/dpl_ch8.h"
+#include "lv2ttl/dpl_ch16.h"
 
 static const RtkLv2Description _plugins[] = {
 	_plugin_stereo,
 	_plugin_mono,
+	_plugin_ch4,
+	_plugin_ch6,
+	_plugin_ch8,
+	_plugin_ch16,
 };
 
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "batch.h"
+#include "peaklim.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define X86_KERNELS
+#endif
+
+using namespace DPLLV2;
+
+HistminLanes::HistminLanes (void)
+    : _hlen (0)
+    , _pos (0)
+    , _blk (0)
+    , _suf (0)
+    , _pre (0)
+{
+}
+
+HistminLanes::~HistminLanes (void)
+{
+	delete[] _blk;
+	delete[] _suf;
+	delete[] _pre;
+}
+
+void
+HistminLanes::init (int hlen, int lanes)
+{
+	delete[] _blk;
+	delete[] _suf;
+	delete[] _pre;
+	_blk = new float[hlen * lanes];
+	_suf = new float[hlen * lanes];
+	_pre = new float[lanes];
+
+	/* same as Histmin: the window initially holds hlen values of 1 */
+	_hlen = hlen;
+	_pos  = 0;
+	for (int i = 0; i < hlen * lanes; ++i) {
+		_suf[i] = 1.f;
+	}
+}
+
+template <int L>
+inline __attribute__ ((always_inline)) void
+HistminLanes::write (const float* v, float* vmin)
+{
+	float* b = _blk + _pos * L;
+
+	for (int l = 0; l < L; ++l) {
+		b[l] = v[l];
+	}
+	if (_pos == 0) {
+		for (int l = 0; l < L; ++l) {
+			_pre[l] = v[l];
+		}
+	} else {
+		for (int l = 0; l < L; ++l) {
+			_pre[l] = (v[l] < _pre[l]) ? v[l] : _pre[l];
+		}
+	}
+
+	if (++_pos < _hlen) {
+		/* the window starts at _pos in the previous block */
+		const float* s = _suf + _pos * L;
+		for (int l = 0; l < L; ++l) {
+			vmin[l] = (s[l] < _pre[l]) ? s[l] : _pre[l];
+		}
+		return;
+	}
+
+	/* block complete, it is the window */
+	for (int l = 0; l < L; ++l) {
+		vmin[l] = _pre[l];
+	}
+
+	float* s = _suf + (_hlen - 1) * L;
+	b        = _blk + (_hlen - 1) * L;
+	for (int l = 0; l < L; ++l) {
+		s[l] = b[l];
+	}
+	for (int i = _hlen - 2; i >= 0; --i) {
+		s -= L;
+		b -= L;
+		for (int l = 0; l < L; ++l) {
+			s[l] = (b[l] < s[l + L]) ? b[l] : s[l + L];
+		}
+	}
+	_pos = 0;
+}
+
+PeaklimBatch::PeaklimBatch (void)
+    : _process (&PeaklimBatch::process_4)
+    , _kname ("")
+    , _fsamp (0)
+    , _nchan (0)
+    , _lanes (0)
+    , _delay (0)
+    , _dmem (0)
+    , _dbuff (0)
+    , _zlf (0)
+{
+}
+
+PeaklimBatch::~PeaklimBatch (void)
+{
+	fini ();
+}
+
+void
+PeaklimBatch::set_inpgain (int lane, float v)
+{
+	if (v == _vgain[lane]) {
+		return;
+	}
+	_vgain[lane] = v;
+	_g1[lane]    = powf (10.f, 0.05f * v);
+}
+
+void
+PeaklimBatch::set_threshold (int lane, float v)
+{
+	if (v == _vthresh[lane]) {
+		return;
+	}
+	_vthresh[lane] = v;
+	_gt1[lane]     = powf (10.f, -0.05f * v);
+	start_ramp (lane);
+}
+
+void
+PeaklimBatch::set_release (int lane, float v)
+{
+	if (v == _vrelease[lane]) {
+		return;
+	}
+	_vrelease[lane] = v;
+	if (v > 1.f) {
+		v = 1.f;
+	}
+	if (v < 1e-3f) {
+		v = 1e-3f;
+	}
+	_w31[lane] = 1.f / (v * _fsamp);
+	start_ramp (lane);
+}
+
+void
+PeaklimBatch::start_ramp (int lane)
+{
+	if (!_running) {
+		_gt[lane]    = _gt1[lane];
+		_w3[lane]    = _w31[lane];
+		_nramp[lane] = 0;
+		return;
+	}
+	_nramp[lane] = _ramplen;
+	_rgt[lane]   = powf (_gt1[lane] / _gt[lane], 1.f / _nramp[lane]);
+	_rw3[lane]   = powf (_w31[lane] / _w3[lane], 1.f / _nramp[lane]);
+}
+
+void
+PeaklimBatch::get_stats (int lane, float* peak, float* gmax, float* gmin)
+{
+	*peak        = _peak[lane];
+	*gmax        = _gmax[lane];
+	*gmin        = _gmin[lane];
+	_rstat[lane] = true;
+}
+
+void
+PeaklimBatch::init (float fsamp, int nchan, int lanes, float lookahead, int isa)
+{
+	fini ();
+	if (nchan < 1) {
+		nchan = 1;
+	}
+	if (lanes > 8) {
+		lanes = 16;
+	} else if (lanes > 4) {
+		lanes = 8;
+	} else {
+		lanes = 4;
+	}
+
+	_fsamp = fsamp;
+	if (fsamp > 130000) {
+		_div1 = 32;
+	} else if (fsamp > 65000) {
+		_div1 = 16;
+	} else {
+		_div1 = 8;
+	}
+
+	/* same as Peaklim::set_lookahead */
+	if (lookahead > Peaklim::MAXLOOKAHEAD) {
+		lookahead = Peaklim::MAXLOOKAHEAD;
+	}
+	if (lookahead < Peaklim::MINLOOKAHEAD) {
+		lookahead = Peaklim::MINLOOKAHEAD;
+	}
+	/* true-peak is not supported, it would need a longer minimum */
+	const int k1 = Peaklim::lookahead_chunks (lookahead, fsamp, _div1, false);
+
+	_nchan = nchan;
+	_lanes = lanes;
+	_div2  = 8;
+	_delay = k1 * _div1;
+
+	int dsize;
+	for (dsize = 64; dsize < _delay + _div1; dsize *= 2) ;
+
+	_dmask = dsize - 1;
+	_delri = 0;
+
+	const size_t dlen = (size_t)dsize * nchan * lanes;
+
+	_dmem  = new float[dlen + 16];
+	_zlf   = new float[nchan * lanes];
+	_dbuff = (float*)(((uintptr_t)_dmem + 63) & ~(uintptr_t)63);
+
+	memset (_dbuff, 0, dlen * sizeof (float));
+	memset (_zlf, 0, nchan * lanes * sizeof (float));
+
+	_hist1.init (k1 + 1, lanes);
+	_hist2.init (12, lanes);
+
+	_c1  = _div1;
+	_c2  = _div2;
+	_wlf = 6.28f * 500.f / fsamp;
+	_w1  = 10.f / _delay;
+	_w2  = _w1 / _div2;
+
+	_ramplen = (int)ceilf (Peaklim::RAMPTIME * fsamp / _div1);
+	_running = false;
+
+	for (int i = 0; i < MAXDIV1; i++) {
+		_pw1[i] = pow (1.0 - _w1, i + 1);
+		_pw2[i] = pow (1.0 - _w2, i + 1);
+	}
+
+	for (int l = 0; l < MAXLANES; ++l) {
+		_g0[l]    = 1.f;
+		_g1[l]    = 1.f;
+		_dg[l]    = 0.f;
+		_gt[l]    = 1.f;
+		_w3[l]    = 1.f / (0.01f * fsamp);
+		_m1[l]    = 0.f;
+		_m2[l]    = 0.f;
+		_z1[l]    = 1.f;
+		_z2[l]    = 1.f;
+		_z3[l]    = 1.f;
+		_h1[l]    = 1.f;
+		_h2[l]    = 1.f;
+		_peak[l]  = 0.f;
+		_gmax[l]  = 1.f;
+		_gmin[l]  = 1.f;
+		_rstat[l] = false;
+
+		_vgain[l]    = 0.f;
+		_vthresh[l]  = 0.f;
+		_vrelease[l] = 0.01f;
+		_gt1[l]      = _gt[l];
+		_w31[l]      = _w3[l];
+		_nramp[l]    = 0;
+	}
+
+	/* kernels are not used, but the ISA they were built for is */
+	const DSPKernels* k = dsp_kernels (isa);
+	if (!k) {
+		k = dsp_kernels (KERNEL_AUTO);
+	}
+
+	static const ProcessFn impl[3][3] = {
+		{ &PeaklimBatch::process_4, &PeaklimBatch::process_8, &PeaklimBatch::process_16 },
+		{ &PeaklimBatch::process_avx2_4, &PeaklimBatch::process_avx2_8, &PeaklimBatch::process_avx2_16 },
+		{ &PeaklimBatch::process_avx512_4, &PeaklimBatch::process_avx512_8, &PeaklimBatch::process_avx512_16 },
+	};
+
+	_kname = k->name;
+
+	int i;
+	switch (dsp_kernel_isa (k->name)) {
+		case KERNEL_AVX2:
+			i = 1;
+			break;
+		case KERNEL_AVX512:
+			i = 2;
+			break;
+		default:
+			i = 0;
+			break;
+	}
+
+	_process = impl[i][lanes == 16 ? 2 : lanes == 8 ? 1 : 0];
+}
+
+void
+PeaklimBatch::fini (void)
+{
+	delete[] _dmem;
+	delete[] _zlf;
+	_dmem  = 0;
+	_dbuff = 0;
+	_zlf   = 0;
+	_nchan = 0;
+}
+
+/* Same as Peaklim::process_impl<false, ...>, one lane per limiter.
+ * Loops over lanes are innermost, and vectorized.
+ */
+template <int L>
+inline __attribute__ ((always_inline)) void
+PeaklimBatch::process_lanes (int nframes, float** inp[], float** out[])
+{
+	const int   nchan = _nchan;
+	const int   ns    = nchan * L; // stride of one sample in the delay-line
+	const float w1    = _w1;
+	const float wlf   = _wlf;
+
+	float g0[L], g1[L], dg[L], gt[L], w3[L];
+	float h1[L], h2[L], m1[L], m2[L], z1[L], z2[L], z3[L];
+	float pk[L], t0[L], t1[L];
+
+	for (int l = 0; l < L; ++l) {
+		g0[l] = _g0[l];
+		g1[l] = _g1[l];
+		dg[l] = _dg[l];
+		gt[l] = _gt[l];
+		w3[l] = _w3[l];
+		h1[l] = _h1[l];
+		h2[l] = _h2[l];
+		m1[l] = _m1[l];
+		m2[l] = _m2[l];
+		z1[l] = _z1[l];
+		z2[l] = _z2[l];
+		z3[l] = _z3[l];
+		if (_rstat[l]) {
+			_rstat[l] = false;
+			pk[l]     = 0;
+			t0[l]     = _gmax[l];
+			t1[l]     = _gmin[l];
+		} else {
+			pk[l] = _peak[l];
+			t0[l] = _gmin[l];
+			t1[l] = _gmax[l];
+		}
+	}
+
+	int ri = _delri;
+	int wi = (ri + _delay) & _dmask;
+	int k  = 0;
+
+	while (nframes) {
+		const int n = (_c1 < nframes) ? _c1 : nframes;
+
+		/* gain, peak and low-pass filtered peak of the input */
+		for (int c = 0; c < nchan; ++c) {
+			const float* src[L];
+			for (int l = 0; l < L; ++l) {
+				src[l] = inp[l][c] + k;
+			}
+			float* z = _zlf + c * L;
+			float* q = _dbuff + wi * ns + c * L;
+			for (int i = 0; i < n; ++i, q += ns) {
+				for (int l = 0; l < L; ++l) {
+					const float x = (g0[l] + i * dg[l]) * src[l][i];
+					const float a = fabsf (x);
+					q[l]          = x;
+					m1[l]         = isgreater (a, m1[l]) ? a : m1[l];
+					z[l] += wlf * (x - z[l]) + 1e-20f;
+					m2[l] = isgreater (fabsf (z[l]), m2[l]) ? fabsf (z[l]) : m2[l];
+				}
+			}
+			for (int l = 0; l < L; ++l) {
+				z[l] = isfinite (z[l]) ? z[l] : 0.f;
+			}
+		}
+		for (int l = 0; l < L; ++l) {
+			g0[l] = g0[l] + n * dg[l];
+		}
+
+		_c1 -= n;
+		if (_c1 == 0) {
+			for (int l = 0; l < L; ++l) {
+				if (_nramp[l]) {
+					if (--_nramp[l] == 0) {
+						gt[l] = _gt1[l];
+						w3[l] = _w31[l];
+					} else {
+						gt[l] *= _rgt[l];
+						w3[l] *= _rw3[l];
+					}
+				}
+			}
+			for (int l = 0; l < L; ++l) {
+				m1[l] *= gt[l];
+				pk[l] = (m1[l] > pk[l]) ? m1[l] : pk[l];
+				m1[l] = (m1[l] > 1.f) ? 1.f / m1[l] : 1.f;
+			}
+			_hist1.write<L> (m1, h1);
+			for (int l = 0; l < L; ++l) {
+				m1[l] = 0;
+			}
+			_c1 = _div1;
+			if (--_c2 == 0) {
+				for (int l = 0; l < L; ++l) {
+					m2[l] *= gt[l];
+					m2[l] = (m2[l] > 1.f) ? 1.f / m2[l] : 1.f;
+				}
+				_hist2.write<L> (m2, h2);
+				for (int l = 0; l < L; ++l) {
+					m2[l] = 0;
+				}
+				_c2 = _div2;
+				for (int l = 0; l < L; ++l) {
+					const float d = g1[l] - g0[l];
+					if (fabsf (d) < 5e-4f) {
+						g0[l] = g1[l];
+						dg[l] = 0;
+					} else {
+						dg[l] = d / (_div1 * _div2 * _div2);
+					}
+				}
+			}
+		}
+
+		/* gain curve, see Peaklim::process_impl */
+		float* gv = _gbuf;
+		float  d1[L], d2[L];
+		for (int l = 0; l < L; ++l) {
+			d1[l] = z1[l] - h1[l];
+			d2[l] = z2[l] - h2[l];
+		}
+		for (int i = 0; i < n; ++i) {
+			for (int l = 0; l < L; ++l) {
+				const float a = h1[l] + d1[l] * _pw1[i];
+				const float b = h2[l] + d2[l] * _pw2[i];
+				const float z = (b < a) ? b : a;
+				const float w = (z < z3[l]) ? w1 : w3[l];
+				z3[l] += w * (z - z3[l]);
+				gv[i * L + l] = z3[l];
+				t1[l]         = (z3[l] > t1[l]) ? z3[l] : t1[l];
+				t0[l]         = (z3[l] < t0[l]) ? z3[l] : t0[l];
+			}
+		}
+		for (int l = 0; l < L; ++l) {
+			z1[l] = h1[l] + d1[l] * _pw1[n - 1];
+			z2[l] = h2[l] + d2[l] * _pw2[n - 1];
+		}
+
+		/* apply gain to all channels */
+		for (int c = 0; c < nchan; ++c) {
+			float* dst[L];
+			for (int l = 0; l < L; ++l) {
+				dst[l] = out[l][c] + k;
+			}
+			const float* q = _dbuff + ri * ns + c * L;
+			for (int i = 0; i < n; ++i, q += ns) {
+				for (int l = 0; l < L; ++l) {
+					dst[l][i] = gv[i * L + l] * q[l];
+				}
+			}
+		}
+
+		wi = (wi + n) & _dmask;
+		ri = (ri + n) & _dmask;
+		k += n;
+		nframes -= n;
+	}
+
+	/* copy back variables */
+	for (int l = 0; l < L; ++l) {
+		_g0[l]   = g0[l];
+		_dg[l]   = dg[l];
+		_gt[l]   = gt[l];
+		_w3[l]   = w3[l];
+		_h1[l]   = h1[l];
+		_h2[l]   = h2[l];
+		_m1[l]   = m1[l];
+		_m2[l]   = m2[l];
+		_z1[l]   = z1[l];
+		_z2[l]   = z2[l];
+		_z3[l]   = z3[l];
+		_peak[l] = pk[l];
+		_gmin[l] = t0[l];
+		_gmax[l] = t1[l];
+	}
+	_delri   = ri;
+	_running = true;
+}
+
+/* The generic template is inlined into functions which are compiled
+ * for the given instruction set, see also kernels.cc.
+ * FMA is not used, to produce the same result as Peaklim. AVX-512F
+ * includes FMA instructions, so contraction is disabled explicitly.
+ */
+#ifdef X86_KERNELS
+#define AVX2_TARGET __attribute__ ((target ("avx2")))
+#define AVX512_TARGET __attribute__ ((target ("avx512f"), optimize ("fp-contract=off")))
+#else
+#define AVX2_TARGET
+#define AVX512_TARGET
+#endif
+
+#define PROCESS_LANES(NAME, TARGET, L)                                     \
+	TARGET void                                                        \
+	PeaklimBatch::NAME (int nframes, float** inp[], float** out[])     \
+	{                                                                  \
+		process_lanes<L> (nframes, inp, out);                      \
+	}
+
+PROCESS_LANES (process_4, , 4)
+PROCESS_LANES (process_8, , 8)
+PROCESS_LANES (process_16, , 16)
+PROCESS_LANES (process_avx2_4, AVX2_TARGET, 4)
+PROCESS_LANES (process_avx2_8, AVX2_TARGET, 8)
+PROCESS_LANES (process_avx2_16, AVX2_TARGET, 16)
+PROCESS_LANES (process_avx512_4, AVX512_TARGET, 4)
+PROCESS_LANES (process_avx512_8, AVX512_TARGET, 8)
+PROCESS_LANES (process_avx512_16, AVX512_TARGET, 16)
+
+#undef PROCESS_LANES
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "kernels.h"
+
+namespace DPLLV2
+{
+/* Minimum of the last hlen values, for each lane (van Herk/Gil-Werman).
+ * Values are collected in blocks of hlen. When a block is complete
+ * its suffix minima are computed, the minimum of the window is then
+ * min (suffix of the previous block, prefix of the current block).
+ * Every step is the same for all lanes, unlike Histmin's deque.
+ */
+class HistminLanes
+{
+public:
+	HistminLanes (void);
+	~HistminLanes (void);
+
+	void init (int hlen, int lanes);
+
+	template <int L>
+	inline void write (const float* v, float* vmin);
+
+private:
+	int    _hlen;
+	int    _pos;
+	float* _blk; // [_hlen][lanes] current block
+	float* _suf; // [_hlen][lanes] suffix minima of the previous block
+	float* _pre; // [lanes] prefix minimum of the current block
+};
+
+/* Up to MAXLANES independent limiters, processed together.
+ * Each step of Peaklim::process is done for all lanes at once: the
+ * state is stored as structure of arrays [...][lane], so that the
+ * compiler can use one vector operation across lanes.
+ *
+ * All lanes share sample-rate, channel-count and look-ahead.
+ * Gain, threshold and release are per lane, and change the same
+ * way as Peaklim's: threshold and release ramp over RAMPTIME once
+ * process_batch () was called. True-peak is not supported, the
+ * output is the same as that of Peaklim (using scalar kernels)
+ * with the same settings and changes at the same time.
+ */
+class PeaklimBatch
+{
+public:
+	enum { MAXLANES = 16 };
+
+	PeaklimBatch (void);
+	~PeaklimBatch (void);
+
+	/* lanes: 4, 8 or 16.
+	 * isa: one of KernelISA, selects the vector instructions to use
+	 */
+	void init (float fsamp, int nchan, int lanes, float lookahead = 1.2f, int isa = KERNEL_AUTO);
+	void fini (void);
+
+	void set_inpgain (int lane, float);
+	void set_threshold (int lane, float);
+	void set_release (int lane, float);
+
+	int
+	get_latency () const
+	{
+		return _delay;
+	}
+
+	int
+	lanes () const
+	{
+		return _lanes;
+	}
+
+	/* the kernel ISA given to init (), or the best available one */
+	const char*
+	kernel_name () const
+	{
+		return _kname;
+	}
+
+	void get_stats (int lane, float* peak, float* gmax, float* gmin);
+
+	/* inp[lane][channel], out[lane][channel] */
+	void
+	process_batch (int nframes, float** inp[], float** out[])
+	{
+		(this->*_process) (nframes, inp, out);
+	}
+
+private:
+	typedef void (PeaklimBatch::*ProcessFn) (int, float**[], float**[]);
+
+	void start_ramp (int lane);
+
+	template <int L>
+	inline void process_lanes (int nframes, float** inp[], float** out[]);
+
+	/* instantiations of process_lanes<> for each ISA */
+	void process_4 (int, float**[], float**[]);
+	void process_8 (int, float**[], float**[]);
+	void process_16 (int, float**[], float**[]);
+	void process_avx2_4 (int, float**[], float**[]);
+	void process_avx2_8 (int, float**[], float**[]);
+	void process_avx2_16 (int, float**[], float**[]);
+	void process_avx512_4 (int, float**[], float**[]);
+	void process_avx512_8 (int, float**[], float**[]);
+	void process_avx512_16 (int, float**[], float**[]);
+
+	enum { MAXDIV1 = 32 };
+
+	ProcessFn   _process;
+	const char* _kname;
+
+	float  _fsamp;
+	int    _nchan;
+	int    _lanes;
+	int    _div1;
+	int    _div2;
+	int    _delay;
+	int    _dmask;
+	int    _delri;
+	float* _dmem;
+	float* _dbuff; // [time][channel][lane]
+	float* _zlf;   // [channel][lane]
+	int    _c1, _c2;
+	float  _w1, _w2, _wlf;
+	int    _ramplen;
+	bool   _running;
+
+	/* z1, z2 step response over a chunk: (1 - w)^(i + 1) */
+	float _pw1[MAXDIV1];
+	float _pw2[MAXDIV1];
+
+	/* per lane */
+	float _g0[MAXLANES] __attribute__ ((aligned (64)));
+	float _g1[MAXLANES] __attribute__ ((aligned (64)));
+	float _dg[MAXLANES] __attribute__ ((aligned (64)));
+	float _gt[MAXLANES] __attribute__ ((aligned (64)));
+	float _w3[MAXLANES] __attribute__ ((aligned (64)));
+	float _m1[MAXLANES] __attribute__ ((aligned (64)));
+	float _m2[MAXLANES] __attribute__ ((aligned (64)));
+	float _z1[MAXLANES] __attribute__ ((aligned (64)));
+	float _z2[MAXLANES] __attribute__ ((aligned (64)));
+	float _z3[MAXLANES] __attribute__ ((aligned (64)));
+	float _h1[MAXLANES] __attribute__ ((aligned (64)));
+	float _h2[MAXLANES] __attribute__ ((aligned (64)));
+	float _peak[MAXLANES] __attribute__ ((aligned (64)));
+	float _gmax[MAXLANES] __attribute__ ((aligned (64)));
+	float _gmin[MAXLANES] __attribute__ ((aligned (64)));
+	bool  _rstat[MAXLANES];
+
+	/* parameter ramps, see Peaklim::start_ramp */
+	float _vgain[MAXLANES];
+	float _vthresh[MAXLANES];
+	float _vrelease[MAXLANES];
+	float _gt1[MAXLANES];
+	float _w31[MAXLANES];
+	float _rgt[MAXLANES];
+	float _rw3[MAXLANES];
+	int   _nramp[MAXLANES];
+
+	/* gain curve of the current chunk [sample][lane] */
+	float _gbuf[MAXDIV1 * MAXLANES] __attribute__ ((aligned (64)));
+
+	HistminLanes _hist1;
+	HistminLanes _hist2;
+};
+
+} // namespace
+
+#endif
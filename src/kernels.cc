@@ -0,0 +1,662 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels.h"
+#include "upsampler.h"
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace DPLLV2;
+
+enum { NTAPS = Upsampler::NTAPS };
+
+/* 4x upsample for true-peak analysis, cosine windowed sinc.
+ * phase 0 is the input sample itself, phase 3 is phase 1 reversed.
+ */
+/* clang-format off */
+static const float _c1[NTAPS] __attribute__ ((aligned (64))) = {
+	-2.330790e-05f, +1.321291e-04f, -3.394408e-04f, +6.562235e-04f,
+	-1.094138e-03f, +1.665807e-03f, -2.385230e-03f, +3.268371e-03f,
+	-4.334012e-03f, +5.604985e-03f, -7.109989e-03f, +8.886314e-03f,
+	-1.098403e-02f, +1.347264e-02f, -1.645206e-02f, +2.007155e-02f,
+	-2.456432e-02f, +3.031531e-02f, -3.800644e-02f, +4.896667e-02f,
+	-6.616853e-02f, +9.788141e-02f, -1.788607e-01f, +9.000753e-01f,
+	+2.993829e-01f, -1.269367e-01f, +7.922398e-02f, -5.647748e-02f,
+	+4.295093e-02f, -3.385706e-02f, +2.724946e-02f, -2.218943e-02f,
+	+1.816976e-02f, -1.489313e-02f, +1.217411e-02f, -9.891211e-03f,
+	+7.961470e-03f, -6.326144e-03f, +4.942202e-03f, -3.777065e-03f,
+	+2.805240e-03f, -2.006106e-03f, +1.362416e-03f, -8.592768e-04f,
+	+4.834383e-04f, -2.228007e-04f, +6.607267e-05f, -2.537056e-06f,
+};
+
+static const float _c2[NTAPS] __attribute__ ((aligned (64))) = {
+	-1.450055e-05f, +1.359163e-04f, -3.928527e-04f, +8.006445e-04f,
+	-1.375510e-03f, +2.134915e-03f, -3.098103e-03f, +4.286860e-03f,
+	-5.726614e-03f, +7.448018e-03f, -9.489286e-03f, +1.189966e-02f,
+	-1.474471e-02f, +1.811472e-02f, -2.213828e-02f, +2.700557e-02f,
+	-3.301023e-02f, +4.062971e-02f, -5.069345e-02f, +6.477499e-02f,
+	-8.625619e-02f, +1.239454e-01f, -2.101678e-01f, +6.359382e-01f,
+	+6.359382e-01f, -2.101678e-01f, +1.239454e-01f, -8.625619e-02f,
+	+6.477499e-02f, -5.069345e-02f, +4.062971e-02f, -3.301023e-02f,
+	+2.700557e-02f, -2.213828e-02f, +1.811472e-02f, -1.474471e-02f,
+	+1.189966e-02f, -9.489286e-03f, +7.448018e-03f, -5.726614e-03f,
+	+4.286860e-03f, -3.098103e-03f, +2.134915e-03f, -1.375510e-03f,
+	+8.006445e-04f, -3.928527e-04f, +1.359163e-04f, -1.450055e-05f,
+};
+
+static const float _c3[NTAPS] __attribute__ ((aligned (64))) = {
+	-2.537056e-06f, +6.607267e-05f, -2.228007e-04f, +4.834383e-04f,
+	-8.592768e-04f, +1.362416e-03f, -2.006106e-03f, +2.805240e-03f,
+	-3.777065e-03f, +4.942202e-03f, -6.326144e-03f, +7.961470e-03f,
+	-9.891211e-03f, +1.217411e-02f, -1.489313e-02f, +1.816976e-02f,
+	-2.218943e-02f, +2.724946e-02f, -3.385706e-02f, +4.295093e-02f,
+	-5.647748e-02f, +7.922398e-02f, -1.269367e-01f, +2.993829e-01f,
+	+9.000753e-01f, -1.788607e-01f, +9.788141e-02f, -6.616853e-02f,
+	+4.896667e-02f, -3.800644e-02f, +3.031531e-02f, -2.456432e-02f,
+	+2.007155e-02f, -1.645206e-02f, +1.347264e-02f, -1.098403e-02f,
+	+8.886314e-03f, -7.109989e-03f, +5.604985e-03f, -4.334012e-03f,
+	+3.268371e-03f, -2.385230e-03f, +1.665807e-03f, -1.094138e-03f,
+	+6.562235e-04f, -3.394408e-04f, +1.321291e-04f, -2.330790e-05f,
+};
+
+/* clang-format on */
+
+/* ****************************************************************************
+ * scalar reference
+ */
+
+/* peak of the 3 interpolated phases for the window r[0 .. NTAPS-1] */
+static inline float
+tp_peak1 (const float* r)
+{
+	float u1 = 0;
+	float u2 = 0;
+	float u3 = 0;
+	for (int k = 0; k < NTAPS; ++k) {
+		u1 += r[k] * _c1[k];
+		u2 += r[k] * _c2[k];
+		u3 += r[k] * _c3[k];
+	}
+	float p = fabsf (u1);
+	if (fabsf (u2) > p) {
+		p = fabsf (u2);
+	}
+	if (fabsf (u3) > p) {
+		p = fabsf (u3);
+	}
+	return p;
+}
+
+static float
+peak_scan_scalar (const float* x, int n, float m)
+{
+	for (int i = 0; i < n; ++i) {
+		const float a = fabsf (x[i]);
+		if (isgreater (a, m)) {
+			m = a;
+		}
+	}
+	return m;
+}
+
+static float
+tp_peak_scalar (const float* h, int n)
+{
+	float p = 0;
+	for (int i = 0; i < n; ++i) {
+		const float u = tp_peak1 (h + i);
+		if (u > p) {
+			p = u;
+		}
+	}
+	/* phase 0: the input samples themselves */
+	return peak_scan_scalar (h + NTAPS - 1, n, p);
+}
+
+static float
+gain_ramp_scalar (float* dst, int mirror, const float* src, int n, float g, float dg)
+{
+	for (int i = 0; i < n; ++i) {
+		dst[i] = dst[mirror + i] = (g + i * dg) * src[i];
+	}
+	return g + n * dg;
+}
+
+static void
+gain_apply_scalar (float* const* out, int oo, float* const* src, int so, int nchan, const float* g, int n)
+{
+	for (int c = 0; c < nchan; ++c) {
+		float*       o = out[c] + oo;
+		const float* s = src[c] + so;
+		for (int i = 0; i < n; ++i) {
+			o[i] = g[i] * s[i];
+		}
+	}
+}
+
+#ifdef X86_KERNELS
+
+/* ****************************************************************************
+ * SSE2
+ */
+
+__attribute__ ((target ("sse2"))) static float
+peak_scan_sse2 (const float* x, int n, float m)
+{
+	const __m128 sgn = _mm_set1_ps (-0.f);
+	__m128       mx  = _mm_set1_ps (m);
+	int          i   = 0;
+	for (; i + 4 <= n; i += 4) {
+		/* operand order: NaN in x yields mx */
+		mx = _mm_max_ps (_mm_andnot_ps (sgn, _mm_loadu_ps (x + i)), mx);
+	}
+	mx = _mm_max_ps (mx, _mm_movehl_ps (mx, mx));
+	mx = _mm_max_ss (mx, _mm_shuffle_ps (mx, mx, 0x01));
+	return peak_scan_scalar (x + i, n - i, _mm_cvtss_f32 (mx));
+}
+
+/* Filter-bank style convolution: consecutive output samples are
+ * computed in parallel (one per vector lane), even and odd taps use
+ * separate accumulators to shorten the dependency chains.
+ */
+__attribute__ ((target ("sse2"))) static float
+tp_peak_sse2 (const float* h, int n)
+{
+	const __m128 sgn = _mm_set1_ps (-0.f);
+	__m128       mx  = _mm_setzero_ps ();
+	int          i   = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 a1 = _mm_setzero_ps ();
+		__m128 a2 = _mm_setzero_ps ();
+		__m128 a3 = _mm_setzero_ps ();
+		__m128 b1 = _mm_setzero_ps ();
+		__m128 b2 = _mm_setzero_ps ();
+		__m128 b3 = _mm_setzero_ps ();
+		for (int k = 0; k < NTAPS; k += 2) {
+			const __m128 v = _mm_loadu_ps (h + i + k);
+			const __m128 w = _mm_loadu_ps (h + i + k + 1);
+			a1 = _mm_add_ps (a1, _mm_mul_ps (v, _mm_set1_ps (_c1[k])));
+			a2 = _mm_add_ps (a2, _mm_mul_ps (v, _mm_set1_ps (_c2[k])));
+			a3 = _mm_add_ps (a3, _mm_mul_ps (v, _mm_set1_ps (_c3[k])));
+			b1 = _mm_add_ps (b1, _mm_mul_ps (w, _mm_set1_ps (_c1[k + 1])));
+			b2 = _mm_add_ps (b2, _mm_mul_ps (w, _mm_set1_ps (_c2[k + 1])));
+			b3 = _mm_add_ps (b3, _mm_mul_ps (w, _mm_set1_ps (_c3[k + 1])));
+		}
+		a1 = _mm_andnot_ps (sgn, _mm_add_ps (a1, b1));
+		a2 = _mm_andnot_ps (sgn, _mm_add_ps (a2, b2));
+		a3 = _mm_andnot_ps (sgn, _mm_add_ps (a3, b3));
+		mx = _mm_max_ps (mx, _mm_max_ps (a1, _mm_max_ps (a2, a3)));
+	}
+	mx      = _mm_max_ps (mx, _mm_movehl_ps (mx, mx));
+	mx      = _mm_max_ss (mx, _mm_shuffle_ps (mx, mx, 0x01));
+	float p = _mm_cvtss_f32 (mx);
+
+	for (; i < n; ++i) {
+		const float u = tp_peak1 (h + i);
+		if (u > p) {
+			p = u;
+		}
+	}
+	return peak_scan_sse2 (h + NTAPS - 1, n, p);
+}
+
+__attribute__ ((target ("sse2"))) static float
+gain_ramp_sse2 (float* dst, int mirror, const float* src, int n, float g, float dg)
+{
+	int i = 0;
+	if (dg == 0) {
+		const __m128 vg = _mm_set1_ps (g);
+		for (; i + 4 <= n; i += 4) {
+			const __m128 y = _mm_mul_ps (vg, _mm_loadu_ps (src + i));
+			_mm_storeu_ps (dst + i, y);
+			_mm_storeu_ps (dst + mirror + i, y);
+		}
+	} else {
+		const __m128 vg = _mm_set1_ps (g);
+		const __m128 vd = _mm_set1_ps (dg);
+		const __m128 v4 = _mm_set1_ps (4.f);
+		__m128       vi = _mm_setr_ps (0.f, 1.f, 2.f, 3.f);
+		for (; i + 4 <= n; i += 4) {
+			const __m128 gi = _mm_add_ps (vg, _mm_mul_ps (vi, vd));
+			const __m128 y  = _mm_mul_ps (gi, _mm_loadu_ps (src + i));
+			_mm_storeu_ps (dst + i, y);
+			_mm_storeu_ps (dst + mirror + i, y);
+			vi = _mm_add_ps (vi, v4);
+		}
+	}
+	for (; i < n; ++i) {
+		dst[i] = dst[mirror + i] = (g + i * dg) * src[i];
+	}
+	return g + n * dg;
+}
+
+/* The gain vector is one chunk (8, 16 or 32 samples), it is loaded once and
+ * kept in registers while all channels are processed.
+ */
+__attribute__ ((target ("sse2"))) static void
+gain_apply_sse2 (float* const* out, int oo, float* const* src, int so, int nchan, const float* g, int n)
+{
+	if (n != 8 && n != 16 && n != 32) {
+		gain_apply_scalar (out, oo, src, so, nchan, g, n);
+		return;
+	}
+	__m128 gv[8];
+	for (int i = 0; i < n; i += 4) {
+		gv[i / 4] = _mm_loadu_ps (g + i);
+	}
+	for (int c = 0; c < nchan; ++c) {
+		float*       o = out[c] + oo;
+		const float* s = src[c] + so;
+		for (int i = 0; i < n; i += 4) {
+			_mm_storeu_ps (o + i, _mm_mul_ps (gv[i / 4], _mm_loadu_ps (s + i)));
+		}
+	}
+}
+
+/* ****************************************************************************
+ * AVX2 + FMA
+ */
+
+__attribute__ ((target ("avx2,fma"))) static float
+peak_scan_avx2 (const float* x, int n, float m)
+{
+	const __m256 sgn = _mm256_set1_ps (-0.f);
+	__m256       mx  = _mm256_set1_ps (m);
+	int          i   = 0;
+	for (; i + 8 <= n; i += 8) {
+		mx = _mm256_max_ps (_mm256_andnot_ps (sgn, _mm256_loadu_ps (x + i)), mx);
+	}
+	__m128 m4 = _mm_max_ps (_mm256_castps256_ps128 (mx), _mm256_extractf128_ps (mx, 1));
+	m4        = _mm_max_ps (m4, _mm_movehl_ps (m4, m4));
+	m4        = _mm_max_ss (m4, _mm_shuffle_ps (m4, m4, 0x01));
+	return peak_scan_scalar (x + i, n - i, _mm_cvtss_f32 (m4));
+}
+
+__attribute__ ((target ("avx2,fma"))) static float
+tp_peak_avx2 (const float* h, int n)
+{
+	const __m256 sgn = _mm256_set1_ps (-0.f);
+	__m256       mx  = _mm256_setzero_ps ();
+	int          i   = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 a1 = _mm256_setzero_ps ();
+		__m256 a2 = _mm256_setzero_ps ();
+		__m256 a3 = _mm256_setzero_ps ();
+		__m256 b1 = _mm256_setzero_ps ();
+		__m256 b2 = _mm256_setzero_ps ();
+		__m256 b3 = _mm256_setzero_ps ();
+		for (int k = 0; k < NTAPS; k += 2) {
+			const __m256 v = _mm256_loadu_ps (h + i + k);
+			const __m256 w = _mm256_loadu_ps (h + i + k + 1);
+			a1 = _mm256_fmadd_ps (v, _mm256_broadcast_ss (_c1 + k), a1);
+			a2 = _mm256_fmadd_ps (v, _mm256_broadcast_ss (_c2 + k), a2);
+			a3 = _mm256_fmadd_ps (v, _mm256_broadcast_ss (_c3 + k), a3);
+			b1 = _mm256_fmadd_ps (w, _mm256_broadcast_ss (_c1 + k + 1), b1);
+			b2 = _mm256_fmadd_ps (w, _mm256_broadcast_ss (_c2 + k + 1), b2);
+			b3 = _mm256_fmadd_ps (w, _mm256_broadcast_ss (_c3 + k + 1), b3);
+		}
+		a1 = _mm256_andnot_ps (sgn, _mm256_add_ps (a1, b1));
+		a2 = _mm256_andnot_ps (sgn, _mm256_add_ps (a2, b2));
+		a3 = _mm256_andnot_ps (sgn, _mm256_add_ps (a3, b3));
+		mx = _mm256_max_ps (mx, _mm256_max_ps (a1, _mm256_max_ps (a2, a3)));
+	}
+	__m128 m4 = _mm_max_ps (_mm256_castps256_ps128 (mx), _mm256_extractf128_ps (mx, 1));
+	m4        = _mm_max_ps (m4, _mm_movehl_ps (m4, m4));
+	m4        = _mm_max_ss (m4, _mm_shuffle_ps (m4, m4, 0x01));
+	float p   = _mm_cvtss_f32 (m4);
+
+	for (; i < n; ++i) {
+		const float u = tp_peak1 (h + i);
+		if (u > p) {
+			p = u;
+		}
+	}
+	return peak_scan_avx2 (h + NTAPS - 1, n, p);
+}
+
+__attribute__ ((target ("avx2,fma"))) static float
+gain_ramp_avx2 (float* dst, int mirror, const float* src, int n, float g, float dg)
+{
+	int i = 0;
+	if (dg == 0) {
+		const __m256 vg = _mm256_set1_ps (g);
+		for (; i + 8 <= n; i += 8) {
+			const __m256 y = _mm256_mul_ps (vg, _mm256_loadu_ps (src + i));
+			_mm256_storeu_ps (dst + i, y);
+			_mm256_storeu_ps (dst + mirror + i, y);
+		}
+	} else {
+		const __m256 vg = _mm256_set1_ps (g);
+		const __m256 vd = _mm256_set1_ps (dg);
+		const __m256 v8 = _mm256_set1_ps (8.f);
+		__m256       vi = _mm256_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+		for (; i + 8 <= n; i += 8) {
+			const __m256 gi = _mm256_fmadd_ps (vi, vd, vg);
+			const __m256 y  = _mm256_mul_ps (gi, _mm256_loadu_ps (src + i));
+			_mm256_storeu_ps (dst + i, y);
+			_mm256_storeu_ps (dst + mirror + i, y);
+			vi = _mm256_add_ps (vi, v8);
+		}
+	}
+	for (; i < n; ++i) {
+		dst[i] = dst[mirror + i] = (g + i * dg) * src[i];
+	}
+	return g + n * dg;
+}
+
+__attribute__ ((target ("avx2,fma"))) static void
+gain_apply_avx2 (float* const* out, int oo, float* const* src, int so, int nchan, const float* g, int n)
+{
+	if (n != 8 && n != 16 && n != 32) {
+		gain_apply_scalar (out, oo, src, so, nchan, g, n);
+		return;
+	}
+	__m256 gv[4];
+	for (int i = 0; i < n; i += 8) {
+		gv[i / 8] = _mm256_loadu_ps (g + i);
+	}
+	for (int c = 0; c < nchan; ++c) {
+		float*       o = out[c] + oo;
+		const float* s = src[c] + so;
+		for (int i = 0; i < n; i += 8) {
+			_mm256_storeu_ps (o + i, _mm256_mul_ps (gv[i / 8], _mm256_loadu_ps (s + i)));
+		}
+	}
+}
+
+/* ****************************************************************************
+ * AVX-512
+ *
+ * Only complete 512 bit vectors are used, remaining samples are handed
+ * to the AVX2 variants. Masked stores would be cheaper to write, but
+ * loads of the same data shortly after (e.g. the delay-line is read
+ * right after the gain-ramp wrote it) cannot be store-forwarded and
+ * stall, which costs more than the kernels save.
+ */
+
+/* same as _mm512_max_ps, w/o -Wmaybe-uninitialized false positives */
+__attribute__ ((target ("avx512f,avx2,fma"))) static inline __m512
+max512 (__m512 a, __m512 b)
+{
+	return _mm512_mask_max_ps (a, 0xffff, a, b);
+}
+
+/* split into 256 bit halves. The masked extract has an explicit
+ * source operand, unlike _mm512_castps512_ps256, which triggers
+ * -Wmaybe-uninitialized with some compilers.
+ */
+__attribute__ ((target ("avx512f,avx2,fma"))) static inline __m256
+lo256 (__m512 v)
+{
+	return _mm256_castpd_ps (_mm512_mask_extractf64x4_pd (_mm256_setzero_pd (), 0xf, _mm512_castps_pd (v), 0));
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static inline __m256
+hi256 (__m512 v)
+{
+	return _mm256_castpd_ps (_mm512_mask_extractf64x4_pd (_mm256_setzero_pd (), 0xf, _mm512_castps_pd (v), 1));
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static inline float
+hmax512 (__m512 v)
+{
+	const __m256 m = _mm256_max_ps (lo256 (v), hi256 (v));
+	__m128       x = _mm_max_ps (_mm256_castps256_ps128 (m), _mm256_extractf128_ps (m, 1));
+	x              = _mm_max_ps (x, _mm_movehl_ps (x, x));
+	x              = _mm_max_ss (x, _mm_shuffle_ps (x, x, 0x01));
+	return _mm_cvtss_f32 (x);
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static float
+peak_scan_avx512 (const float* x, int n, float m)
+{
+	if (n < 16) {
+		return peak_scan_avx2 (x, n, m);
+	}
+	__m512 mx = _mm512_set1_ps (m);
+	int    i  = 0;
+	for (; i + 16 <= n; i += 16) {
+		mx = max512 (_mm512_abs_ps (_mm512_loadu_ps (x + i)), mx);
+	}
+	return (i < n) ? peak_scan_avx2 (x + i, n - i, hmax512 (mx)) : hmax512 (mx);
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static float
+tp_peak_avx512 (const float* h, int n)
+{
+	if (n < 16) {
+		return tp_peak_avx2 (h, n);
+	}
+	__m512 mx = _mm512_setzero_ps ();
+	int    i  = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 a1 = _mm512_setzero_ps ();
+		__m512 a2 = _mm512_setzero_ps ();
+		__m512 a3 = _mm512_setzero_ps ();
+		__m512 b1 = _mm512_setzero_ps ();
+		__m512 b2 = _mm512_setzero_ps ();
+		__m512 b3 = _mm512_setzero_ps ();
+		for (int k = 0; k < NTAPS; k += 2) {
+			const __m512 v = _mm512_loadu_ps (h + i + k);
+			const __m512 w = _mm512_loadu_ps (h + i + k + 1);
+			a1 = _mm512_fmadd_ps (v, _mm512_set1_ps (_c1[k]), a1);
+			a2 = _mm512_fmadd_ps (v, _mm512_set1_ps (_c2[k]), a2);
+			a3 = _mm512_fmadd_ps (v, _mm512_set1_ps (_c3[k]), a3);
+			b1 = _mm512_fmadd_ps (w, _mm512_set1_ps (_c1[k + 1]), b1);
+			b2 = _mm512_fmadd_ps (w, _mm512_set1_ps (_c2[k + 1]), b2);
+			b3 = _mm512_fmadd_ps (w, _mm512_set1_ps (_c3[k + 1]), b3);
+		}
+		a1 = _mm512_abs_ps (_mm512_add_ps (a1, b1));
+		a2 = _mm512_abs_ps (_mm512_add_ps (a2, b2));
+		a3 = _mm512_abs_ps (_mm512_add_ps (a3, b3));
+		mx = max512 (mx, max512 (a1, max512 (a2, a3)));
+	}
+	float p = hmax512 (mx);
+	if (i < n) {
+		/* includes phase 0 of the remaining samples */
+		const float u = tp_peak_avx2 (h + i, n - i);
+		if (u > p) {
+			p = u;
+		}
+	}
+	return peak_scan_avx512 (h + NTAPS - 1, i, p);
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static float
+gain_ramp_avx512 (float* dst, int mirror, const float* src, int n, float g, float dg)
+{
+	const __m512 vg  = _mm512_set1_ps (g);
+	const __m512 vd  = _mm512_set1_ps (dg);
+	const __m512 v16 = _mm512_set1_ps (16.f);
+	__m512       vi  = _mm512_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f,
+	                                   8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+	int          i   = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m512 gi = _mm512_fmadd_ps (vi, vd, vg);
+		const __m512 y  = _mm512_mul_ps (gi, _mm512_loadu_ps (src + i));
+		_mm512_storeu_ps (dst + i, y);
+		_mm512_storeu_ps (dst + mirror + i, y);
+		vi = _mm512_add_ps (vi, v16);
+	}
+	if (i + 8 <= n) {
+		/* same index based ramp as above, for bit-identical results */
+		const __m256 gi = _mm256_fmadd_ps (lo256 (vi), _mm256_set1_ps (dg), _mm256_set1_ps (g));
+		const __m256 y  = _mm256_mul_ps (gi, _mm256_loadu_ps (src + i));
+		_mm256_storeu_ps (dst + i, y);
+		_mm256_storeu_ps (dst + mirror + i, y);
+		i += 8;
+	}
+	for (; i < n; ++i) {
+		dst[i] = dst[mirror + i] = (g + i * dg) * src[i];
+	}
+	return g + n * dg;
+}
+
+__attribute__ ((target ("avx512f,avx2,fma"))) static void
+gain_apply_avx512 (float* const* out, int oo, float* const* src, int so, int nchan, const float* g, int n)
+{
+	if (n != 16 && n != 32) {
+		gain_apply_avx2 (out, oo, src, so, nchan, g, n);
+		return;
+	}
+	const __m512 g0 = _mm512_loadu_ps (g);
+	const __m512 g1 = (n == 32) ? _mm512_loadu_ps (g + 16) : g0;
+	for (int c = 0; c < nchan; ++c) {
+		float*       o = out[c] + oo;
+		const float* s = src[c] + so;
+		_mm512_storeu_ps (o, _mm512_mul_ps (g0, _mm512_loadu_ps (s)));
+		if (n == 32) {
+			_mm512_storeu_ps (o + 16, _mm512_mul_ps (g1, _mm512_loadu_ps (s + 16)));
+		}
+	}
+}
+
+#endif // X86_KERNELS
+
+/* ****************************************************************************
+ * runtime dispatch
+ */
+
+static const DSPKernels kernels_scalar = {
+	"scalar",
+	tp_peak_scalar,
+	gain_ramp_scalar,
+	peak_scan_scalar,
+	gain_apply_scalar
+};
+
+#ifdef X86_KERNELS
+static const DSPKernels kernels_sse2 = {
+	"sse2",
+	tp_peak_sse2,
+	gain_ramp_sse2,
+	peak_scan_sse2,
+	gain_apply_sse2
+};
+
+static const DSPKernels kernels_avx2 = {
+	"avx2",
+	tp_peak_avx2,
+	gain_ramp_avx2,
+	peak_scan_avx2,
+	gain_apply_avx2
+};
+
+static const DSPKernels kernels_avx512 = {
+	"avx512",
+	tp_peak_avx512,
+	gain_ramp_avx512,
+	peak_scan_avx512,
+	gain_apply_avx512
+};
+#endif
+
+float
+DPLLV2::tp_peak_gain (void)
+{
+	const float* c[3] = { _c1, _c2, _c3 };
+	float        g    = 1.f; // phase 0
+	for (int p = 0; p < 3; ++p) {
+		float s = 0;
+		for (int k = 0; k < NTAPS; ++k) {
+			s += fabsf (c[p][k]);
+		}
+		if (s > g) {
+			g = s;
+		}
+	}
+	return g;
+}
+
+int
+DPLLV2::dsp_kernel_isa (const char* name)
+{
+	if (!name) {
+		return KERNEL_AUTO;
+	}
+	if (!strcmp (name, "scalar")) {
+		return KERNEL_SCALAR;
+	}
+	if (!strcmp (name, "sse2")) {
+		return KERNEL_SSE2;
+	}
+	if (!strcmp (name, "avx2")) {
+		return KERNEL_AVX2;
+	}
+	if (!strcmp (name, "avx512")) {
+		return KERNEL_AVX512;
+	}
+	return KERNEL_AUTO;
+}
+
+/* NULL if the CPU does not support the given ISA */
+static const DSPKernels*
+kernels_for_isa (int isa)
+{
+#ifdef X86_KERNELS
+	__builtin_cpu_init ();
+	const bool have_sse2   = __builtin_cpu_supports ("sse2");
+	const bool have_avx2   = __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+	const bool have_avx512 = have_avx2 && __builtin_cpu_supports ("avx512f");
+
+	switch (isa) {
+		case KERNEL_SCALAR:
+			return &kernels_scalar;
+		case KERNEL_SSE2:
+			return have_sse2 ? &kernels_sse2 : NULL;
+		case KERNEL_AVX2:
+			return have_avx2 ? &kernels_avx2 : NULL;
+		case KERNEL_AVX512:
+			return have_avx512 ? &kernels_avx512 : NULL;
+		default:
+			break;
+	}
+
+	/* AVX-512 is only used on request: with chunks of 8..32 samples
+	 * it is not faster than AVX2, and 512 bit instructions may lower
+	 * the clock-speed of the core for everything else.
+	 */
+	if (have_avx2) {
+		return &kernels_avx2;
+	}
+	if (have_sse2) {
+		return &kernels_sse2;
+	}
+#else
+	if (isa != KERNEL_AUTO && isa != KERNEL_SCALAR) {
+		return NULL;
+	}
+#endif
+	return &kernels_scalar;
+}
+
+const DSPKernels*
+DPLLV2::dsp_kernels (int isa)
+{
+	if (isa != KERNEL_AUTO) {
+		return kernels_for_isa (isa);
+	}
+	const DSPKernels* k = kernels_for_isa (dsp_kernel_isa (getenv ("DPL_KERNEL")));
+	return k ? k : kernels_for_isa (KERNEL_AUTO);
+}
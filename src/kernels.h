@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _KERNELS_H
+#define _KERNELS_H
+
+namespace DPLLV2
+{
+/* Hot loops of the limiter. Every ISA variant is compiled into the
+ * same binary (using function target attributes) and one is picked
+ * at runtime, depending on the CPU.
+ */
+struct DSPKernels {
+	const char* name;
+
+	/* true-peak: h[0 .. NTAPS - 2] is history, followed by n new samples.
+	 * Returns the peak of the 4x upsampled signal of the new samples.
+	 */
+	float (*tp_peak) (const float* h, int n);
+
+	/* dst[i] = dst[mirror + i] = (g + i * dg) * src[i],
+	 * returns the gain for sample n
+	 */
+	float (*gain_ramp) (float* dst, int mirror, const float* src, int n, float g, float dg);
+
+	/* max (m, fabsf (x[i])), NaN is ignored */
+	float (*peak_scan) (const float* x, int n, float m);
+
+	/* out[c][oo + i] = g[i] * src[c][so + i] for all nchan channels */
+	void (*gain_apply) (float* const* out, int oo, float* const* src, int so, int nchan, const float* g, int n);
+};
+
+enum KernelISA {
+	KERNEL_AUTO = 0,
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2,
+	KERNEL_AVX512,
+};
+
+/* Return kernels for the given ISA, or NULL if the CPU does not
+ * support it. KERNEL_AUTO picks the best available one (up to AVX2),
+ * unless the DPL_KERNEL environment variable names a variant.
+ */
+extern const DSPKernels* dsp_kernels (int isa);
+
+/* parse "scalar", "sse2", "avx2", "avx512"; returns KERNEL_AUTO otherwise */
+extern int dsp_kernel_isa (const char* name);
+
+/* Upper bound of the true-peak relative to the sample-peak in the
+ * filter's window: the L1 norm of the interpolation filter.
+ */
+extern float tp_peak_gain (void);
+
+} // namespace
+
+#endif
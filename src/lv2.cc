@@ -40,6 +40,35 @@
 #include <pango/pangocairo.h>
 #endif
 
+#ifdef WITH_DSPLOAD
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/* Reference cycles of the time-stamp counter on x86: it runs at the
+ * nominal clock rate on any CPU made in the last decade, not the current
+ * core clock. Nanoseconds elsewhere. Only differences are used. */
+#if defined(__i386__) || defined(__x86_64__)
+#define DSP_UNIT DSP_UNIT_TSC
+#else
+#define DSP_UNIT DSP_UNIT_NS
+#endif
+
+static inline uint64_t
+dsp_clock (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __rdtsc ();
+#else
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+#endif
+
 #ifndef MAX
 #define MAX(A, B) ((A) > (B)) ? (A) : (B)
 #endif
@@ -49,7 +78,20 @@
 #endif
 
 typedef struct {
-	float* _port[PLIM_LAST];
+	float* _port[PLIM_NCTRL];
+
+	/* audio I/O */
+	uint32_t n_channels;
+	float**  ins;
+	float**  outs;
+	float**  ins_ofs; // ins, outs at an event's offset
+	float**  outs_ofs;
+
+	/* gain, threshold, release: port values at the last change,
+	 * and the current value (the port or a patch:Set event)
+	 */
+	float ctl_port[3];
+	float ctl_value[3];
 
 	DPLLV2::Peaklim* peaklim;
 
@@ -58,10 +100,23 @@ typedef struct {
 	float    _min[HISTLEN];
 	float    _max[HISTLEN];
 	uint32_t _hist;
+	uint32_t _hseq;  // history entries since instantiate
+	uint32_t _hsent; // _hseq when history was last sent to the UI
 
-	uint32_t samplecnt;
+	uint64_t stattick;  // sample position of the next history entry
 	uint32_t sampletme; // 50ms
 
+	/* per-chunk statistics since the last history entry */
+	float st_peak;
+	float st_gmin;
+	float st_gmax;
+
+	/* DSP load, dsp_clock () per sample */
+	uint64_t dsp_cycles;
+	uint64_t dsp_samples;
+	float    dsp_mean; // of the last 50ms
+	float    dsp_peak; // maximum of any run (), since the UI was opened
+
 	/* atom-forge, UI communication */
 	const LV2_Atom_Sequence* control;
 	LV2_Atom_Sequence*       notify;
@@ -73,6 +128,7 @@ typedef struct {
 	/* GUI state */
 	bool  ui_active;
 	bool  send_state_to_ui;
+	bool  send_history;
 	float ui_scale;
 
 #ifdef DISPLAY_INTERFACE
@@ -100,6 +156,14 @@ instantiate (const LV2_Descriptor*     descriptor,
 		n_channels = 1;
 	} else if (!strcmp (descriptor->URI, PLIM_URI "stereo")) {
 		n_channels = 2;
+	} else if (!strcmp (descriptor->URI, PLIM_URI "ch4")) {
+		n_channels = 4;
+	} else if (!strcmp (descriptor->URI, PLIM_URI "ch6")) {
+		n_channels = 6;
+	} else if (!strcmp (descriptor->URI, PLIM_URI "ch8")) {
+		n_channels = 8;
+	} else if (!strcmp (descriptor->URI, PLIM_URI "ch16")) {
+		n_channels = 16;
 	} else {
 		free (self);
 		return NULL;
@@ -137,10 +201,23 @@ instantiate (const LV2_Descriptor*     descriptor,
 		self->_min[i] = self->_max[i] = 1.0;
 	}
 
+	self->n_channels = n_channels;
+	self->ins        = (float**)calloc (n_channels, sizeof (float*));
+	self->outs       = (float**)calloc (n_channels, sizeof (float*));
+	self->ins_ofs    = (float**)calloc (n_channels, sizeof (float*));
+	self->outs_ofs   = (float**)calloc (n_channels, sizeof (float*));
+
+	for (int i = 0; i < 3; ++i) {
+		self->ctl_port[i] = NAN; // use the port on the first run
+	}
+
 	self->peaklim = new DPLLV2::Peaklim ();
 	self->peaklim->init (rate, n_channels);
 
 	self->sampletme = ceilf (rate * 0.05); // 50ms
+	self->stattick  = self->sampletme;
+	self->st_gmin   = 1.f;
+	self->st_gmax   = 0.f;
 
 	if (options) {
 		LV2_URID atom_Float = self->map->map (self->map->handle, LV2_ATOM__Float);
@@ -168,13 +245,26 @@ connect_port (LV2_Handle instance,
 		self->control = (const LV2_Atom_Sequence*)data;
 	} else if (port == PLIM_ATOM_NOTIFY) {
 		self->notify = (LV2_Atom_Sequence*)data;
-	} else if (port < PLIM_LAST) {
+	} else if (port < PLIM_INPUT0) {
 		self->_port[port] = (float*)data;
+	} else if (port < PLIM_INPUT0 + 2 * self->n_channels) {
+		/* audio ports: in, out pairs for each channel */
+		const uint32_t c = (port - PLIM_INPUT0) / 2;
+		if ((port - PLIM_INPUT0) & 1) {
+			self->outs[c] = (float*)data;
+		} else {
+			self->ins[c] = (float*)data;
+		}
+	} else if (port - 2 * self->n_channels < PLIM_NCTRL) {
+		/* control ports after the audio ports */
+		self->_port[port - 2 * self->n_channels] = (float*)data;
 	}
 }
 
-/** forge atom-vector of raw data */
-static void
+/** forge atom-vector of raw data, the complete history.
+ * Returns false if it did not fit into the notify buffer.
+ */
+static bool
 tx_history (Plim* self)
 {
 	LV2_Atom_Forge_Frame frame;
@@ -186,15 +276,53 @@ tx_history (Plim* self)
 	lv2_atom_forge_property_head (&self->forge, self->uris.position, 0);
 	lv2_atom_forge_int (&self->forge, self->_hist);
 
+	lv2_atom_forge_property_head (&self->forge, self->uris.sequence, 0);
+	lv2_atom_forge_int (&self->forge, self->_hseq);
+
 	/* add vector of floats raw */
 	lv2_atom_forge_property_head (&self->forge, self->uris.minvals, 0);
 	lv2_atom_forge_vector (&self->forge, sizeof (float), self->uris.atom_Float, HISTLEN, self->_min);
 
 	lv2_atom_forge_property_head (&self->forge, self->uris.maxvals, 0);
-	lv2_atom_forge_vector (&self->forge, sizeof (float), self->uris.atom_Float, HISTLEN, self->_max);
+	/* the last write is the largest: if it fits, all previous did */
+	LV2_Atom_Forge_Ref ok = lv2_atom_forge_vector (&self->forge, sizeof (float), self->uris.atom_Float, HISTLEN, self->_max);
 
 	/* close off atom-object */
 	lv2_atom_forge_pop (&self->forge, &frame);
+	return ok != 0;
+}
+
+/** forge only the last n (<= HISTLEN) history entries, oldest first.
+ * 'sequence' is the _hseq of the first one, the UI can detect gaps.
+ */
+static bool
+tx_history_delta (Plim* self, uint32_t n)
+{
+	float mins[HISTLEN];
+	float maxs[HISTLEN];
+
+	uint32_t p = (self->_hist + HISTLEN - n) % HISTLEN;
+	for (uint32_t i = 0; i < n; ++i) {
+		mins[i] = self->_min[p];
+		maxs[i] = self->_max[p];
+		p       = (p + 1) % HISTLEN;
+	}
+
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&self->forge, 0);
+	x_forge_object (&self->forge, &frame, 1, self->uris.histdelta);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.sequence, 0);
+	lv2_atom_forge_int (&self->forge, self->_hseq - n);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.minvals, 0);
+	lv2_atom_forge_vector (&self->forge, sizeof (float), self->uris.atom_Float, n, mins);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.maxvals, 0);
+	LV2_Atom_Forge_Ref ok = lv2_atom_forge_vector (&self->forge, sizeof (float), self->uris.atom_Float, n, maxs);
+
+	lv2_atom_forge_pop (&self->forge, &frame);
+	return ok != 0;
 }
 
 static void
@@ -210,19 +338,109 @@ tx_state (Plim* self)
 	lv2_atom_forge_pop (&self->forge, &frame);
 }
 
+#ifdef WITH_DSPLOAD
+static void
+tx_dspload (Plim* self)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&self->forge, 0);
+	x_forge_object (&self->forge, &frame, 1, self->uris.dspload);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.dsp_mean, 0);
+	lv2_atom_forge_float (&self->forge, self->dsp_mean);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.dsp_peak, 0);
+	lv2_atom_forge_float (&self->forge, self->dsp_peak);
+
+	lv2_atom_forge_property_head (&self->forge, self->uris.dsp_unit, 0);
+	lv2_atom_forge_int (&self->forge, DSP_UNIT);
+
+	lv2_atom_forge_pop (&self->forge, &frame);
+}
+#endif
+
+/* range of the gain, threshold and release ports */
+static const float ctl_min[3] = { -10.f, -10.f, .001f };
+static const float ctl_max[3] = { 30.f, 0.f, 1.f };
+
+static void
+apply_params (Plim* self)
+{
+	/* these only compute coefficients if the value changed */
+	self->peaklim->set_inpgain (self->ctl_value[0]);
+	self->peaklim->set_threshold (self->ctl_value[1]);
+	self->peaklim->set_release (self->ctl_value[2]);
+}
+
+/** parse a patch:Set of gain, threshold or release, sets *p to
+ * the index (0..2) and *v to the value.
+ */
+static bool
+parse_patch_set (Plim* self, const LV2_Atom_Object* obj, int* p, float* v)
+{
+	const LV2_Atom* property = NULL;
+	const LV2_Atom* value    = NULL;
+
+	lv2_atom_object_get (obj, self->uris.patch_property, &property, self->uris.patch_value, &value, 0);
+	if (!property || property->type != self->uris.atom_URID || !value || value->type != self->uris.atom_Float) {
+		return false;
+	}
+
+	const LV2_URID key = ((const LV2_Atom_URID*)property)->body;
+	if (key == self->uris.p_gain) {
+		*p = 0;
+	} else if (key == self->uris.p_threshold) {
+		*p = 1;
+	} else if (key == self->uris.p_release) {
+		*p = 2;
+	} else {
+		return false;
+	}
+
+	*v = ((const LV2_Atom_Float*)value)->body;
+	if (!(*v >= ctl_min[*p])) { // also NaN
+		*v = ctl_min[*p];
+	}
+	if (*v > ctl_max[*p]) {
+		*v = ctl_max[*p];
+	}
+	return true;
+}
+
+static void
+process_range (Plim* self, uint32_t offset, uint32_t n_samples)
+{
+	if (offset == 0) {
+		self->peaklim->process (n_samples, self->ins, self->outs);
+		return;
+	}
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		self->ins_ofs[c]  = self->ins[c] + offset;
+		self->outs_ofs[c] = self->outs[c] + offset;
+	}
+	self->peaklim->process (n_samples, self->ins_ofs, self->outs_ofs);
+}
+
 static void
 run (LV2_Handle instance, uint32_t n_samples)
 {
 	Plim* self = (Plim*)instance;
 
+#ifdef WITH_DSPLOAD
+	const uint64_t t0 = dsp_clock ();
+#endif
+
+	/* does not allocate, latency changes accordingly */
+	self->peaklim->set_lookahead (*self->_port[PLIM_LOOKAHEAD]);
+
 	if (!self->control || !self->notify) {
 		*self->_port[PLIM_LEVEL]   = -10;
 		*self->_port[PLIM_LATENCY] = self->peaklim->get_latency ();
-		if (self->_port[PLIM_INPUT0] != self->_port[PLIM_OUTPUT0]) {
-			memcpy (self->_port[PLIM_OUTPUT0], self->_port[PLIM_INPUT0], n_samples * sizeof (float));
-		}
-		if (self->_port[PLIM_INPUT1] != self->_port[PLIM_OUTPUT1]) {
-			memcpy (self->_port[PLIM_OUTPUT1], self->_port[PLIM_INPUT1], n_samples * sizeof (float));
+		*self->_port[PLIM_DSPLOAD] = 0;
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			if (self->ins[c] != self->outs[c]) {
+				memcpy (self->outs[c], self->ins[c], n_samples * sizeof (float));
+			}
 		}
 		return;
 	}
@@ -232,17 +450,46 @@ run (LV2_Handle instance, uint32_t n_samples)
 	lv2_atom_forge_set_buffer (&self->forge, (uint8_t*)self->notify, capacity);
 	lv2_atom_forge_sequence_head (&self->forge, &self->frame, 0);
 
-	/* process messages from GUI; */
+	/* bypass/enable */
+	const bool enable = *self->_port[PLIM_ENABLE] > 0;
+
+	/* port changes apply from the start of the block */
+	for (int i = 0; i < 3; ++i) {
+		const float v = *self->_port[PLIM_GAIN + i];
+		if (v != self->ctl_port[i]) {
+			self->ctl_port[i]  = v;
+			self->ctl_value[i] = v;
+		}
+	}
+
+	apply_params (self);
+	self->peaklim->set_truepeak (*self->_port[PLIM_TRUEPEAK] > 0);
+	self->peaklim->set_bypass (!enable);
+
+	/* process messages from GUI, and automation events at their frame */
+	uint32_t offset = 0;
 	if (self->control) {
 		LV2_Atom_Event* ev = lv2_atom_sequence_begin (&(self->control)->body);
 		while (!lv2_atom_sequence_is_end (&(self->control)->body, (self->control)->atom.size, ev)) {
 			if (ev->body.type == self->uris.atom_Blank || ev->body.type == self->uris.atom_Object) {
 				const LV2_Atom_Object* obj = (LV2_Atom_Object*)&ev->body;
-				if (obj->body.otype == self->uris.ui_off) {
+				int                    pidx;
+				float                  pval;
+				if (obj->body.otype == self->uris.patch_Set && parse_patch_set (self, obj, &pidx, &pval)) {
+					const int64_t  t     = ev->time.frames;
+					const uint32_t frame = t < 0 ? 0 : (t < n_samples ? t : n_samples);
+					if (frame > offset) {
+						process_range (self, offset, frame - offset);
+						offset = frame;
+					}
+					self->ctl_value[pidx] = pval;
+					apply_params (self);
+				} else if (obj->body.otype == self->uris.ui_off) {
 					self->ui_active = false;
 				} else if (obj->body.otype == self->uris.ui_on) {
 					self->ui_active        = true;
 					self->send_state_to_ui = true;
+					self->dsp_peak         = 0;
 				} else if (obj->body.otype == self->uris.state) {
 					const LV2_Atom* v = NULL;
 					lv2_atom_object_get (obj, self->uris.s_uiscale, &v, 0);
@@ -255,38 +502,50 @@ run (LV2_Handle instance, uint32_t n_samples)
 		}
 	}
 
-#define BYPASS_THRESH 40 // dBFS
-
-	/* bypass/enable */
-	const bool enable = *self->_port[PLIM_ENABLE] > 0;
-
-	if (enable) {
-		self->peaklim->set_inpgain (*self->_port[PLIM_GAIN]);
-		self->peaklim->set_threshold (*self->_port[PLIM_THRESHOLD]);
-		self->peaklim->set_release (*self->_port[PLIM_RELEASE]);
-		self->peaklim->set_truepeak (*self->_port[PLIM_TRUEPEAK] > 0);
-	} else {
-		self->peaklim->set_inpgain (0);
-		self->peaklim->set_threshold (BYPASS_THRESH);
-		self->peaklim->set_release (.05);
-		self->peaklim->set_truepeak (*self->_port[PLIM_TRUEPEAK] > 0);
+	if (offset < n_samples) {
+		process_range (self, offset, n_samples - offset);
 	}
 
-	float* ins[2]  = { self->_port[PLIM_INPUT0], self->_port[PLIM_INPUT1] };
-	float* outs[2] = { self->_port[PLIM_OUTPUT0], self->_port[PLIM_OUTPUT1] };
+#ifdef WITH_DSPLOAD
+	if (n_samples > 0) {
+		/* excludes the 50ms stats and UI messages below */
+		const uint64_t dt = dsp_clock () - t0;
+		const float    cs = dt / (float)n_samples;
+		self->dsp_cycles += dt;
+		self->dsp_samples += n_samples;
+		if (cs > self->dsp_peak) {
+			self->dsp_peak = cs;
+		}
+	}
+#endif
 
-	self->peaklim->process (n_samples, ins, outs);
+	/* collect per-chunk statistics, one history entry every 50ms */
+	DPLLV2::PeaklimStats st;
+	while (self->peaklim->read_stats (&st)) {
+		self->st_peak = fmaxf (self->st_peak, st.peak);
+		self->st_gmin = fminf (self->st_gmin, st.gmin);
+		self->st_gmax = fmaxf (self->st_gmax, st.gmax);
 
-	bool tx = false;
+		if (st.pos < self->stattick) {
+			continue;
+		}
 
-	self->samplecnt += n_samples;
-	while (self->samplecnt >= self->sampletme) {
-		self->samplecnt -= self->sampletme;
-		float pk;
-		self->peaklim->get_stats (&pk, &self->_max[self->_hist], &self->_min[self->_hist]);
+		float pk = self->st_peak < 0.1 ? -20 : (20. * log10f (self->st_peak));
 
-		pk = pk < 0.1 ? -20 : (20. * log10f (pk));
+		self->_min[self->_hist] = self->st_gmin;
+		self->_max[self->_hist] = self->st_gmax;
+		self->st_peak           = 0.f;
+		self->st_gmin           = 1.f;
+		self->st_gmax           = 0.f;
+		self->stattick += self->sampletme;
 
+#ifdef WITH_DSPLOAD
+		if (self->dsp_samples > 0) {
+			self->dsp_mean    = self->dsp_cycles / (double)self->dsp_samples;
+			self->dsp_cycles  = 0;
+			self->dsp_samples = 0;
+		}
+#endif
 		if (self->_peak > -20) {
 			self->_peak -= .3; // 6dB/sec
 		}
@@ -303,18 +562,40 @@ run (LV2_Handle instance, uint32_t n_samples)
 #endif
 
 		self->_hist = (self->_hist + 1) % HISTLEN;
-		tx          = true;
+		++self->_hseq;
 	}
 
 	*self->_port[PLIM_LEVEL]   = enable ? fmaxf (-10.f, self->_peak) : -10;
 	*self->_port[PLIM_LATENCY] = self->peaklim->get_latency ();
+	*self->_port[PLIM_DSPLOAD] = self->dsp_mean;
 
 	if (self->ui_active && self->send_state_to_ui) {
 		self->send_state_to_ui = false;
+		self->send_history     = true;
 		tx_state (self);
-		tx_history (self);
-	} else if (self->ui_active && tx) {
-		tx_history (self);
+	}
+
+	if (self->ui_active) {
+		/* Only send entries that the UI does not have yet. The complete
+		 * history on ui_on, or if the notify buffer was too small for
+		 * HISTLEN entries in a row.
+		 */
+		const uint32_t n    = self->_hseq - self->_hsent;
+		bool           sent = false;
+		if (self->send_history || n > HISTLEN) {
+			sent               = tx_history (self);
+			self->send_history = !sent;
+		} else if (n > 0) {
+			sent = tx_history_delta (self, n);
+		}
+		if (sent) {
+			self->_hsent = self->_hseq;
+		}
+#ifdef WITH_DSPLOAD
+		if (sent) {
+			tx_dspload (self);
+		}
+#endif
 	}
 
 	/* close off atom-sequence */
@@ -373,6 +654,10 @@ cleanup (LV2_Handle instance)
 {
 	Plim* self = (Plim*)instance;
 	delete self->peaklim;
+	free (self->ins);
+	free (self->outs);
+	free (self->ins_ofs);
+	free (self->outs_ofs);
 #ifdef DISPLAY_INTERFACE
 	if (self->mpat) {
 		cairo_pattern_destroy (self->mpat);
@@ -550,6 +835,50 @@ static const LV2_Descriptor descriptor_stereo = {
 	extension_data
 };
 
+static const LV2_Descriptor descriptor_ch4 = {
+	PLIM_URI "ch4",
+	instantiate,
+	connect_port,
+	NULL,
+	run,
+	NULL,
+	cleanup,
+	extension_data
+};
+
+static const LV2_Descriptor descriptor_ch6 = {
+	PLIM_URI "ch6",
+	instantiate,
+	connect_port,
+	NULL,
+	run,
+	NULL,
+	cleanup,
+	extension_data
+};
+
+static const LV2_Descriptor descriptor_ch8 = {
+	PLIM_URI "ch8",
+	instantiate,
+	connect_port,
+	NULL,
+	run,
+	NULL,
+	cleanup,
+	extension_data
+};
+
+static const LV2_Descriptor descriptor_ch16 = {
+	PLIM_URI "ch16",
+	instantiate,
+	connect_port,
+	NULL,
+	run,
+	NULL,
+	cleanup,
+	extension_data
+};
+
 /* clang-format off */
 #undef LV2_SYMBOL_EXPORT
 #ifdef _WIN32
@@ -567,6 +896,14 @@ lv2_descriptor (uint32_t index)
 			return &descriptor_mono;
 		case 1:
 			return &descriptor_stereo;
+		case 2:
+			return &descriptor_ch4;
+		case 3:
+			return &descriptor_ch6;
+		case 4:
+			return &descriptor_ch8;
+		case 5:
+			return &descriptor_ch16;
 		default:
 			return NULL;
 	}
@@ -17,62 +17,127 @@
  */
 
 #include <algorithm>
-#include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "peaklim.h"
 
 using namespace DPLLV2;
 
+const float Peaklim::MINLOOKAHEAD = 0.25f;
+const float Peaklim::MAXLOOKAHEAD = 10.f;
+const float Peaklim::RAMPTIME     = 0.01f;  // threshold, release: 10ms
+const float Peaklim::BYPASSTIME   = 0.005f; // crossfade: 5ms
+
+Histmin::Histmin (void)
+    : _hlen (0)
+    , _hval (0)
+    , _htim (0)
+{
+}
+
+Histmin::~Histmin (void)
+{
+	delete[] _hval;
+	delete[] _htim;
+}
+
 void
-Histmin::init (int hlen)
+Histmin::init (int hlen, int maxlen)
 {
-	assert (hlen <= SIZE);
-	_hlen = hlen;
-	_hold = hlen;
-	_wind = 0;
-	_vmin = 1;
-	for (int i = 0; i < SIZE; i++) {
-		_hist[i] = _vmin;
+	if (maxlen < hlen) {
+		maxlen = hlen;
 	}
+
+	int size;
+	for (size = 32; size <= maxlen; size *= 2) ;
+
+	delete[] _hval;
+	delete[] _htim;
+	_hval = new float[size];
+	_htim = new uint32_t[size];
+
+	/* the window initially holds hlen values of 1, the last one
+	 * written at time 0 */
+	_hlen    = hlen;
+	_mask    = size - 1;
+	_time    = 0;
+	_rd      = 0;
+	_wr      = 1;
+	_vmin    = 1;
+	_hval[0] = _vmin;
+	_htim[0] = _time;
+}
+
+/* forget all values, as if hlen values of 1 were written */
+void
+Histmin::reset (void)
+{
+	_rd      = 0;
+	_wr      = 1;
+	_vmin    = 1;
+	_hval[0] = _vmin;
+	_htim[0] = _time;
+}
+
+/* hlen must not exceed the maxlen given to init().
+ * When shortening the window, values that are now too old
+ * are dropped with the next write().
+ */
+void
+Histmin::set_length (int hlen)
+{
+	_hlen = hlen;
 }
 
 float
 Histmin::write (float v)
 {
-	int i    = _wind;
-	_hist[i] = v;
-
-	if (v <= _vmin) {
-		_vmin = v;
-		_hold = _hlen;
-	} else if (--_hold == 0) {
-		_vmin = v;
-		_hold = _hlen;
-		for (int j = 1 - _hlen; j < 0; j++) {
-			v = _hist[(i + j) & MASK];
-			if (v < _vmin) {
-				_vmin = v;
-				_hold = _hlen + j;
-			}
-		}
+	++_time;
+
+	/* drop older values that can no longer become the minimum */
+	while (_wr != _rd && _hval[(_wr - 1) & _mask] >= v) {
+		--_wr;
+	}
+	_hval[_wr & _mask] = v;
+	_htim[_wr & _mask] = _time;
+	++_wr;
+
+	/* expire the oldest ones, when they leave the window */
+	while (_time - _htim[_rd & _mask] >= (uint32_t)_hlen) {
+		++_rd;
 	}
-	_wind = ++i & MASK;
+
+	_vmin = _hval[_rd & _mask];
 	return _vmin;
 }
 
 Peaklim::Peaklim (void)
-    : _fsamp (0)
+    : _kern (dsp_kernels (KERNEL_SCALAR))
+    , _process (&Peaklim::process_impl<false, 0, 8, false>)
+    , _envelope (&Peaklim::process_impl<false, 0, 8, true>)
+    , _fsamp (0)
     , _nchan (0)
-    , _rstat (false)
-    , _peak (0)
-    , _gmax (1)
-    , _gmin (1)
+    , _dmem (0)
+    , _dbuff (0)
+    , _zlf (0)
     , _truepeak (false)
+    , _tplazy (true)
+    , _tpchunks (0)
+    , _tpskip (0)
+    , _spos (0)
+    , _slen (0)
+    , _speak (0)
+    , _sgmin (1)
+    , _sgmax (0)
+    , _bstate (BP_ACTIVE)
+    , _bypass (false)
+    , _xmem (0)
+    , _xbuff (0)
+    , _bin (0)
+    , _bout (0)
 {
-	for (int i = 0; i < MAXCHAN; i++)
-		_dbuff[i] = 0;
 }
 
 Peaklim::~Peaklim (void)
@@ -83,25 +148,55 @@ Peaklim::~Peaklim (void)
 void
 Peaklim::set_inpgain (float v)
 {
-	_g1 = powf (10.f, 0.05f * v);
+	if (v == _vgain) {
+		return;
+	}
+	_vgain = v;
+	_g1    = powf (10.f, 0.05f * v);
 }
 
 void
 Peaklim::set_threshold (float v)
 {
-	_gt = powf (10.f, -0.05f * v);
+	if (v == _vthresh) {
+		return;
+	}
+	_vthresh = v;
+	_gt1     = powf (10.f, -0.05f * v);
+	start_ramp ();
 }
 
 void
 Peaklim::set_release (float v)
 {
+	if (v == _vrelease) {
+		return;
+	}
+	_vrelease = v;
 	if (v > 1.f) {
 		v = 1.f;
 	}
 	if (v < 1e-3f) {
 		v = 1e-3f;
 	}
-	_w3 = 1.f / (v * _fsamp);
+	_w31 = 1.f / (v * _fsamp);
+	start_ramp ();
+}
+
+void
+Peaklim::start_ramp (void)
+{
+	if (!_running) {
+		/* initial settings apply immediately */
+		_gt    = _gt1;
+		_w3    = _w31;
+		_nramp = 0;
+		return;
+	}
+	/* geometric, from the current (possibly ramping) values */
+	_nramp = _ramplen;
+	_rgt   = powf (_gt1 / _gt, 1.f / _nramp);
+	_rw3   = powf (_w31 / _w3, 1.f / _nramp);
 }
 
 void
@@ -110,21 +205,118 @@ Peaklim::set_truepeak (bool v)
 	if (_truepeak == v) {
 		return;
 	}
-	for (int i = 0; i < _nchan; i++) {
-		for (int j = 0; j < 48; ++j) {
-			_z[i][j] = 0.0f;
+	_truepeak = v;
+	select_process ();
+	if (_dbuff) {
+		/* the minimum look-ahead depends on it */
+		set_lookahead (_vlookahead);
+	}
+}
+
+void
+Peaklim::set_lookahead (float v)
+{
+	if (v > MAXLOOKAHEAD) {
+		v = MAXLOOKAHEAD;
+	}
+	if (v < MINLOOKAHEAD) {
+		v = MINLOOKAHEAD;
+	}
+
+	_vlookahead = v;
+
+	int k1 = lookahead_chunks (v, _fsamp, _div1, _truepeak);
+	if (k1 * _div1 > _dmax) {
+		k1 = _dmax / _div1;
+	}
+
+	const int delay = k1 * _div1;
+	if (delay == _delay) {
+		return;
+	}
+
+	/* keep the write position, move the read position. The delay
+	 * is a multiple of _div1, so chunks remain aligned in the ring.
+	 */
+	_delri = (_delri + _delay - delay) & _dmask;
+	_delay = delay;
+	_hist1.set_length (k1 + 1);
+
+	_w1 = 10.f / _delay;
+	_w2 = _w1 / _div2;
+
+	for (int i = 0; i < MAXDIV1; i++) {
+		_pw1[i] = pow (1.0 - _w1, i + 1);
+		_pw2[i] = pow (1.0 - _w2, i + 1);
+	}
+}
+
+int
+Peaklim::lookahead_chunks (float v, float fsamp, int div1, bool truepeak)
+{
+	int k1;
+	if (v == 1.2f) {
+		/* the default, as it was when the look-ahead was fixed */
+		k1 = (int)(ceilf (1.2e-3f * fsamp / div1));
+	} else {
+		/* the tolerance avoids rounding up a whole chunk,
+		 * e.g. 10ms at 48kHz is 60 chunks.
+		 */
+		k1 = (int)(ceilf (1e-3f * v * fsamp / div1 - 1e-3f));
+	}
+	/* at least two, so that w1 < 1 */
+	if (k1 < 2) {
+		k1 = 2;
+	}
+	/* the upsampler reports an inter-sample peak NTAPS / 2 samples
+	 * after it entered the delay-line. As for a sample-peak, the
+	 * gain-reduction then needs one more chunk to reach it.
+	 */
+	if (truepeak) {
+		while (k1 * div1 < Upsampler::NTAPS / 2 + 2 * div1) {
+			++k1;
 		}
 	}
-	_truepeak = v;
+	return k1;
 }
 
 void
-Peaklim::init (float fsamp, int nchan)
+Peaklim::set_truepeak_lazy (bool v)
+{
+	_tplazy = v;
+}
+
+int
+Peaklim::get_settle_time (float tolerance) const
+{
+	/* hold: look-ahead and the longer of the two history windows */
+	const int k1   = _delay / _div1 + 1;
+	const int k2   = 12 * _div2;
+	const int hold = _delay + _div1 * (k1 > k2 ? k1 : k2);
+
+	/* then differences decay exponentially, at worst with the
+	 * slowest of z2, the release (z3) and the peak low-pass.
+	 */
+	float w = _w2 < _w3 ? _w2 : _w3;
+	if (_wlf < w) {
+		w = _wlf;
+	}
+	return hold + (int)ceilf (logf (1.f / tolerance) / w);
+}
+
+void
+Peaklim::init (float fsamp, int nchan, int isa)
 {
 	fini ();
-	if (nchan > MAXCHAN) {
-		nchan = MAXCHAN;
+	if (nchan < 1) {
+		nchan = 1;
+	}
+
+	_kern = dsp_kernels (isa);
+	if (!_kern) {
+		_kern = dsp_kernels (KERNEL_AUTO);
 	}
+
 	_fsamp = fsamp;
 	if (fsamp > 130000) {
 		_div1 = 32;
@@ -136,26 +328,61 @@ Peaklim::init (float fsamp, int nchan)
 
 	_nchan = nchan;
 	_div2  = 8;
-	int k1 = (int)(ceilf (1.2e-3f * fsamp / _div1));
-	int k2 = 12;
-	_delay = k1 * _div1;
+	int kmax = (int)(ceilf (1e-3f * MAXLOOKAHEAD * fsamp / _div1 - 1e-3f));
+	int k2   = 12;
+	_dmax    = kmax * _div1;
+	_delay   = 0;
 
-	int dly_size;
-	for (dly_size = 64; dly_size < _delay + _div1; dly_size *= 2) ;
+	for (_dsize = 64; _dsize < _dmax + _div1 || _dsize < Upsampler::NTAPS - 1 + _div1; _dsize *= 2) ;
 
-	_dmask = dly_size - 1;
+	_dmask = _dsize - 1;
 	_delri = 0;
+	_upsampler.init (_kern);
+
+	/* The delay-line of each channel is mirrored: 2 * _dsize samples,
+	 * every sample is written at i and i + _dsize. Any window of up
+	 * to _dsize samples starting at [0, _dsize) is contiguous.
+	 * All channels share one 64-byte aligned allocation, the stride is
+	 * padded by one cache-line to avoid 4K aliasing between channels.
+	 */
+	const int dstride = 2 * _dsize + 16;
+
+	_dmem      = new float[_nchan * dstride + 16];
+	_dbuff     = new float*[_nchan];
+	_zlf       = new float[_nchan];
+
+	memset (_dmem, 0, (_nchan * dstride + 16) * sizeof (float));
+	float* d = (float*)(((uintptr_t)_dmem + 63) & ~(uintptr_t)63);
 
 	for (int i = 0; i < _nchan; i++) {
-		_dbuff[i] = new float[dly_size];
-		memset (_dbuff[i], 0, dly_size * sizeof (float));
-		_zlf[i] = 0.f;
-		for (int j = 0; j < 48; ++j) {
-			_z[i][j] = 0.0f;
-		}
+		_dbuff[i] = d + i * dstride;
+		_zlf[i]   = 0.f;
+	}
+
+	/* dry delay-line for bypass, not mirrored. Up to _xseg samples
+	 * are written before reading the delayed ones.
+	 */
+	for (_xsize = 64; _xsize < _dmax + 1024; _xsize *= 2) ;
+
+	_xmask = _xsize - 1;
+	_xseg  = _xsize - _dmax;
+	_xwi   = 0;
+	_xmem  = new float[_nchan * _xsize];
+	_xbuff = new float*[_nchan];
+	_bin   = new float*[_nchan];
+	_bout  = new float*[_nchan];
+
+	memset (_xmem, 0, _nchan * _xsize * sizeof (float));
+	for (int i = 0; i < _nchan; i++) {
+		_xbuff[i] = _xmem + i * _xsize;
 	}
 
-	_hist1.init (k1 + 1);
+	_bstate = BP_ACTIVE;
+	_bypass = false;
+	_xfade  = 0.f;
+	_xstep  = 1.f / ceilf (BYPASSTIME * fsamp);
+
+	_hist1.init (kmax + 1);
 	_hist2.init (k2);
 
 	_c1  = _div1;
@@ -163,8 +390,6 @@ Peaklim::init (float fsamp, int nchan)
 	_m1  = 0.f;
 	_m2  = 0.f;
 	_wlf = 6.28f * 500.f / fsamp;
-	_w1  = 10.f / _delay;
-	_w2  = _w1 / _div2;
 	_w3  = 1.f / (0.01f * fsamp);
 	_z1  = 1.f;
 	_z2  = 1.f;
@@ -174,19 +399,358 @@ Peaklim::init (float fsamp, int nchan)
 	_g1  = 1.f;
 	_dg  = 0.f;
 
-	_peak = 0.f;
-	_gmax = 1.f;
-	_gmin = 1.f;
+	/* the values corresponding to the above */
+	_vgain    = 0.f;
+	_vthresh  = 0.f;
+	_vrelease = 0.01f;
+	_gt1      = _gt;
+	_w31      = _w3;
+	_nramp    = 0;
+	_ramplen  = (int)ceilf (RAMPTIME * fsamp / _div1);
+	_running  = false;
+
+	_spos  = 0;
+	_slen  = 0;
+	_speak = 0.f;
+	_sgmin = 1.f;
+	_sgmax = 0.f;
+	_stats.reset ();
+
+	_tpchunks = 0;
+	_tpskip   = 0;
+
+	set_lookahead (1.2f);
+
+	select_process ();
 }
 
+#define PROCESS_NCHAN(TP, DIV1)                             \
+	{                                                   \
+		&Peaklim::process_impl<TP, 0, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 1, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 2, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 4, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 6, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 8, DIV1, false>,  \
+		&Peaklim::process_impl<TP, 16, DIV1, false>, \
+	}
+
+/* offline only, mono and stereo are specialized */
+#define ENVELOPE_NCHAN(TP, DIV1)                          \
+	{                                                 \
+		&Peaklim::process_impl<TP, 0, DIV1, true>, \
+		&Peaklim::process_impl<TP, 1, DIV1, true>, \
+		&Peaklim::process_impl<TP, 2, DIV1, true>, \
+	}
+
+/* pick a process() specialization for the current configuration,
+ * called when the channel-count, sample-rate or true-peak mode changes.
+ */
+void
+Peaklim::select_process (void)
+{
+	static const ProcessFn impl[2][3][7] = {
+		{ PROCESS_NCHAN (false, 8), PROCESS_NCHAN (false, 16), PROCESS_NCHAN (false, 32) },
+		{ PROCESS_NCHAN (true, 8), PROCESS_NCHAN (true, 16), PROCESS_NCHAN (true, 32) },
+	};
+	static const ProcessFn env[2][3][3] = {
+		{ ENVELOPE_NCHAN (false, 8), ENVELOPE_NCHAN (false, 16), ENVELOPE_NCHAN (false, 32) },
+		{ ENVELOPE_NCHAN (true, 8), ENVELOPE_NCHAN (true, 16), ENVELOPE_NCHAN (true, 32) },
+	};
+
+	int d, c;
+	if (_div1 >= 32) {
+		d = 2;
+	} else if (_div1 >= 16) {
+		d = 1;
+	} else {
+		d = 0;
+	}
+
+	switch (_nchan) {
+		case 1: c = 1; break;
+		case 2: c = 2; break;
+		case 4: c = 3; break;
+		case 6: c = 4; break;
+		case 8: c = 5; break;
+		case 16: c = 6; break;
+		default: c = 0; break;
+	}
+
+	_process  = impl[_truepeak ? 1 : 0][d][c];
+	_envelope = env[_truepeak ? 1 : 0][d][c < 3 ? c : 0];
+}
+
+#undef PROCESS_NCHAN
+#undef ENVELOPE_NCHAN
+
 void
 Peaklim::fini (void)
 {
-	for (int i = 0; i < MAXCHAN; i++) {
-		delete[] _dbuff[i];
-		_dbuff[i] = 0;
+	delete[] _dmem;
+	delete[] _dbuff;
+	delete[] _zlf;
+	delete[] _xmem;
+	delete[] _xbuff;
+	delete[] _bin;
+	delete[] _bout;
+	_dmem      = 0;
+	_dbuff     = 0;
+	_zlf       = 0;
+	_xmem      = 0;
+	_xbuff     = 0;
+	_bin       = 0;
+	_bout      = 0;
+	_nchan     = 0;
+}
+
+void
+Peaklim::set_bypass (bool v)
+{
+	if (_bypass == v) {
+		return;
+	}
+	_bypass = v;
+
+	if (!_running) {
+		/* both delay-lines are silent */
+		_bstate = v ? BP_BYPASSED : BP_ACTIVE;
+		_xfade  = v ? 1.f : 0.f;
+		return;
+	}
+
+	switch (_bstate) {
+		case BP_ACTIVE:
+			/* the maximum, in case the look-ahead changes meanwhile */
+			_bstate = BP_FILLDRY;
+			_bcnt   = _dmax;
+			break;
+		case BP_FILLDRY:
+			/* the output is still the limiter's */
+			_bstate = BP_ACTIVE;
+			break;
+		case BP_BYPASSED:
+			/* the limiter's state is from before bypass, start over */
+			reset_gain ();
+			_bstate = BP_FILLWET;
+			_bcnt   = _dmax;
+			break;
+		case BP_FILLWET:
+			_bstate = BP_BYPASSED;
+			break;
+		case BP_FADE:
+			/* reverses direction */
+			break;
+	}
+}
+
+void
+Peaklim::reset_gain (void)
+{
+	_hist1.reset ();
+	_hist2.reset ();
+	for (int i = 0; i < _nchan; i++) {
+		_zlf[i] = 0.f;
+	}
+	_m1 = 0.f;
+	_m2 = 0.f;
+	_z1 = 1.f;
+	_z2 = 1.f;
+	_z3 = 1.f;
+}
+
+/* limiter, for n samples at offset k */
+void
+Peaklim::process_at (int k, int n, float* inp[], float* out[])
+{
+	for (int j = 0; j < _nchan; j++) {
+		_bin[j]  = inp[j] + k;
+		_bout[j] = out[j] + k;
+	}
+	(this->*_process) (n, _bin, _bout);
+}
+
+void
+Peaklim::dry_write (float* const* inp, int k, int n)
+{
+	const int n1 = (_xwi + n > _xsize) ? _xsize - _xwi : n;
+	for (int j = 0; j < _nchan; j++) {
+		memcpy (_xbuff[j] + _xwi, inp[j] + k, n1 * sizeof (float));
+		memcpy (_xbuff[j], inp[j] + k + n1, (n - n1) * sizeof (float));
+	}
+	_xwi = (_xwi + n) & _xmask;
+}
+
+/* the n samples written last, delayed by the look-ahead */
+void
+Peaklim::dry_read (float* const* out, int k, int n)
+{
+	const int ri = (_xwi - n - _delay) & _xmask;
+	const int n1 = (ri + n > _xsize) ? _xsize - ri : n;
+	for (int j = 0; j < _nchan; j++) {
+		memcpy (out[j] + k, _xbuff[j] + ri, n1 * sizeof (float));
+		memcpy (out[j] + k + n1, _xbuff[j], (n - n1) * sizeof (float));
+	}
+}
+
+/* out += x * (dry - out), x changes by dx per sample, returns x at the end */
+float
+Peaklim::dry_mix (float* const* out, int k, int n, float x, float dx)
+{
+	const int ri = (_xwi - n - _delay) & _xmask;
+	for (int j = 0; j < _nchan; j++) {
+		const float* d = _xbuff[j];
+		float*       o = out[j] + k;
+		for (int i = 0; i < n; i++) {
+			float g = x + dx * (i + 1);
+			g       = g < 0.f ? 0.f : (g > 1.f ? 1.f : g);
+			o[i] += g * (d[(ri + i) & _xmask] - o[i]);
+		}
+	}
+	return x + dx * n;
+}
+
+/* statistics while the limiter is not running: no gain reduction */
+void
+Peaklim::stats_idle (int n)
+{
+	_spos += n;
+	_slen += n;
+	_sgmax = 1.f;
+	if (_slen >= (uint32_t)_div1) {
+		const PeaklimStats st = { _spos, _slen, _speak, _sgmin, _sgmax };
+		if (_stats.push (st)) {
+			_slen  = 0;
+			_speak = 0.f;
+			_sgmin = 1.f;
+			_sgmax = 0.f;
+		}
+	}
+}
+
+/* everything but BP_ACTIVE, see set_bypass () */
+void
+Peaklim::process_bypass (int nframes, float* inp[], float* out[])
+{
+	_running = true;
+
+	int k = 0;
+	while (nframes > 0) {
+		if (_bstate == BP_ACTIVE) {
+			/* crossfade ended in this cycle */
+			process_at (k, nframes, inp, out);
+			return;
+		}
+
+		/* the dry input is written first, for in-place processing */
+		int n = nframes < _xseg ? nframes : _xseg;
+
+		switch (_bstate) {
+			case BP_BYPASSED:
+				dry_write (inp, k, n);
+				dry_read (out, k, n);
+				stats_idle (n);
+				break;
+
+			case BP_FILLDRY:
+			case BP_FILLWET:
+				if (n > _bcnt) {
+					n = _bcnt;
+				}
+				dry_write (inp, k, n);
+				process_at (k, n, inp, out);
+				if (_bstate == BP_FILLWET) {
+					dry_read (out, k, n);
+				}
+				_bcnt -= n;
+				if (_bcnt <= 0) {
+					_bstate = BP_FADE;
+				}
+				break;
+
+			case BP_FADE: {
+				const float dx = _bypass ? _xstep : -_xstep;
+				const int   m  = (int)ceilf ((_bypass ? 1.f - _xfade : _xfade) / _xstep - 1e-3f);
+				if (n > m) {
+					n = m;
+				}
+				if (n > 0) {
+					dry_write (inp, k, n);
+					process_at (k, n, inp, out);
+					_xfade = dry_mix (out, k, n, _xfade, dx);
+				}
+				if (n == m) {
+					_xfade  = _bypass ? 1.f : 0.f;
+					_bstate = _bypass ? BP_BYPASSED : BP_ACTIVE;
+				}
+			} break;
+
+			case BP_ACTIVE:
+				break;
+		}
+		k += n;
+		nframes -= n;
 	}
-	_nchan = 0;
+}
+
+/* Low-pass filter the gained input of all channels (_zlf),
+ * d[c][off .. off + n), return max (m, |_zlf|).
+ * The recurrence is sequential in time, but independent for
+ * each channel. Channels are processed in groups of four
+ * so that the filters can run in parallel.
+ */
+template <int NChan>
+float
+Peaklim::lpf_peak (float* const* d, int off, int n, float m)
+{
+	const int   nchan = NChan ? NChan : _nchan;
+	const float w     = _wlf;
+	int         j     = 0;
+
+	for (; j + 4 <= nchan; j += 4) {
+		const float* q0 = d[j] + off;
+		const float* q1 = d[j + 1] + off;
+		const float* q2 = d[j + 2] + off;
+		const float* q3 = d[j + 3] + off;
+
+		float z0 = _zlf[j];
+		float z1 = _zlf[j + 1];
+		float z2 = _zlf[j + 2];
+		float z3 = _zlf[j + 3];
+		float m0 = m;
+		float m1 = m;
+		float m2 = m;
+		float m3 = m;
+
+		for (int i = 0; i < n; i++) {
+			z0 += w * (q0[i] - z0) + 1e-20f;
+			z1 += w * (q1[i] - z1) + 1e-20f;
+			z2 += w * (q2[i] - z2) + 1e-20f;
+			z3 += w * (q3[i] - z3) + 1e-20f;
+			m0 = isgreater (fabsf (z0), m0) ? fabsf (z0) : m0;
+			m1 = isgreater (fabsf (z1), m1) ? fabsf (z1) : m1;
+			m2 = isgreater (fabsf (z2), m2) ? fabsf (z2) : m2;
+			m3 = isgreater (fabsf (z3), m3) ? fabsf (z3) : m3;
+		}
+
+		_zlf[j]     = isfinite (z0) ? z0 : 0.f;
+		_zlf[j + 1] = isfinite (z1) ? z1 : 0.f;
+		_zlf[j + 2] = isfinite (z2) ? z2 : 0.f;
+		_zlf[j + 3] = isfinite (z3) ? z3 : 0.f;
+
+		m = std::max (std::max (m0, m1), std::max (m2, m3));
+	}
+
+	for (; j < nchan; j++) {
+		const float* q = d[j] + off;
+		float        z = _zlf[j];
+		for (int i = 0; i < n; i++) {
+			z += w * (q[i] - z) + 1e-20f;
+			m = isgreater (fabsf (z), m) ? fabsf (z) : m;
+		}
+		_zlf[j] = isfinite (z) ? z : 0.f;
+	}
+	return m;
 }
 
 /*
@@ -194,7 +758,7 @@ Peaklim::fini (void)
  * _g0 : current gain (LPFed)
  * _dg : gain-delta per sample, updated every (_div1 * _div2) samples
  *
- * _gt : threshold
+ * _gt : threshold, ramps to _gt1 (per _div1 cycle, see start_ramp)
  *
  * _m1 : digital-peak (reset per _div1 cycle)
  * _m2 : low-pass filtered (_wlf) digital-peak (reset per _div2 cycle)
@@ -216,16 +780,26 @@ Peaklim::fini (void)
  *
  * _w1 : 10 / delay;
  * _w2 : _w1 / _div2
- * _w3 : user-set release time
+ * _w3 : user-set release time, ramps to _w31 like _gt
  *
  * _delri: offset in delay ringbuffer
  * ri, wi; read/write indices
+ *
+ * Env: envelope () instead of process (). The input-gain is applied
+ * to inp[] in place, which takes the role of the delay-line, and the
+ * gain is written to out[0] instead of being applied.
  */
+template <bool TruePeak, int NChan, int Div1, bool Env>
 void
-Peaklim::process (int nframes, float* inp[], float* out[])
+Peaklim::process_impl (int nframes, float* inp[], float* out[])
 {
-	int   ri, wi;
-	float h1, h2, m1, m2, z1, z2, z3, pk, t0, t1;
+	const int   nchan = NChan ? NChan : _nchan;
+	const float w1    = _w1;
+	float       w3    = _w3;
+
+	int      ri, wi;
+	float    h1, h2, m1, m2, z1, z2, z3, pk, t0, t1;
+	uint32_t len;
 
 	ri = _delri;
 	wi = (ri + _delay) & _dmask;
@@ -237,104 +811,77 @@ Peaklim::process (int nframes, float* inp[], float* out[])
 	z2 = _z2;
 	z3 = _z3;
 
-	if (_rstat) {
-		_rstat = false;
-		pk     = 0;
-		t0     = _gmax;
-		t1     = _gmin;
-	} else {
-		pk = _peak;
-		t0 = _gmin;
-		t1 = _gmax;
-	}
+	pk  = _speak;
+	t0  = _sgmin;
+	t1  = _sgmax;
+	len = _slen;
 
 	int k = 0;
 	while (nframes) {
-		int   n = (_c1 < nframes) ? _c1 : nframes;
-		float g = _g0;
-		for (int j = 0; j < _nchan; j++) {
-			const float* p = inp[j] + k;
-			const float  d = _dg;
-			float        z = _zlf[j];
-
-			g = _g0;
-			for (int i = 0; i < n; i++) {
-				float x = g * *p++;
-				g += d;
-				_dbuff[j][wi + i] = x;
-				z += _wlf * (x - z) + 1e-20f;
-
-				if (_truepeak) {
-					float* r = _z[j];
-					float  u[4];
-					r[47] = x;
-					/* 4x upsample for true-peak analysis, cosine windowed sinc */
-					/* clang-format off */
-					u[0] = r[47];
-					u[1] = r[ 0] * -2.330790e-05f + r[ 1] * +1.321291e-04f + r[ 2] * -3.394408e-04f + r[ 3] * +6.562235e-04f
-					     + r[ 4] * -1.094138e-03f + r[ 5] * +1.665807e-03f + r[ 6] * -2.385230e-03f + r[ 7] * +3.268371e-03f
-					     + r[ 8] * -4.334012e-03f + r[ 9] * +5.604985e-03f + r[10] * -7.109989e-03f + r[11] * +8.886314e-03f
-					     + r[12] * -1.098403e-02f + r[13] * +1.347264e-02f + r[14] * -1.645206e-02f + r[15] * +2.007155e-02f
-					     + r[16] * -2.456432e-02f + r[17] * +3.031531e-02f + r[18] * -3.800644e-02f + r[19] * +4.896667e-02f
-					     + r[20] * -6.616853e-02f + r[21] * +9.788141e-02f + r[22] * -1.788607e-01f + r[23] * +9.000753e-01f
-					     + r[24] * +2.993829e-01f + r[25] * -1.269367e-01f + r[26] * +7.922398e-02f + r[27] * -5.647748e-02f
-					     + r[28] * +4.295093e-02f + r[29] * -3.385706e-02f + r[30] * +2.724946e-02f + r[31] * -2.218943e-02f
-					     + r[32] * +1.816976e-02f + r[33] * -1.489313e-02f + r[34] * +1.217411e-02f + r[35] * -9.891211e-03f
-					     + r[36] * +7.961470e-03f + r[37] * -6.326144e-03f + r[38] * +4.942202e-03f + r[39] * -3.777065e-03f
-					     + r[40] * +2.805240e-03f + r[41] * -2.006106e-03f + r[42] * +1.362416e-03f + r[43] * -8.592768e-04f
-					     + r[44] * +4.834383e-04f + r[45] * -2.228007e-04f + r[46] * +6.607267e-05f + r[47] * -2.537056e-06f;
-					u[2] = r[ 0] * -1.450055e-05f + r[ 1] * +1.359163e-04f + r[ 2] * -3.928527e-04f + r[ 3] * +8.006445e-04f
-					     + r[ 4] * -1.375510e-03f + r[ 5] * +2.134915e-03f + r[ 6] * -3.098103e-03f + r[ 7] * +4.286860e-03f
-					     + r[ 8] * -5.726614e-03f + r[ 9] * +7.448018e-03f + r[10] * -9.489286e-03f + r[11] * +1.189966e-02f
-					     + r[12] * -1.474471e-02f + r[13] * +1.811472e-02f + r[14] * -2.213828e-02f + r[15] * +2.700557e-02f
-					     + r[16] * -3.301023e-02f + r[17] * +4.062971e-02f + r[18] * -5.069345e-02f + r[19] * +6.477499e-02f
-					     + r[20] * -8.625619e-02f + r[21] * +1.239454e-01f + r[22] * -2.101678e-01f + r[23] * +6.359382e-01f
-					     + r[24] * +6.359382e-01f + r[25] * -2.101678e-01f + r[26] * +1.239454e-01f + r[27] * -8.625619e-02f
-					     + r[28] * +6.477499e-02f + r[29] * -5.069345e-02f + r[30] * +4.062971e-02f + r[31] * -3.301023e-02f
-					     + r[32] * +2.700557e-02f + r[33] * -2.213828e-02f + r[34] * +1.811472e-02f + r[35] * -1.474471e-02f
-					     + r[36] * +1.189966e-02f + r[37] * -9.489286e-03f + r[38] * +7.448018e-03f + r[39] * -5.726614e-03f
-					     + r[40] * +4.286860e-03f + r[41] * -3.098103e-03f + r[42] * +2.134915e-03f + r[43] * -1.375510e-03f
-					     + r[44] * +8.006445e-04f + r[45] * -3.928527e-04f + r[46] * +1.359163e-04f + r[47] * -1.450055e-05f;
-					u[3] = r[ 0] * -2.537056e-06f + r[ 1] * +6.607267e-05f + r[ 2] * -2.228007e-04f + r[ 3] * +4.834383e-04f
-					     + r[ 4] * -8.592768e-04f + r[ 5] * +1.362416e-03f + r[ 6] * -2.006106e-03f + r[ 7] * +2.805240e-03f
-					     + r[ 8] * -3.777065e-03f + r[ 9] * +4.942202e-03f + r[10] * -6.326144e-03f + r[11] * +7.961470e-03f
-					     + r[12] * -9.891211e-03f + r[13] * +1.217411e-02f + r[14] * -1.489313e-02f + r[15] * +1.816976e-02f
-					     + r[16] * -2.218943e-02f + r[17] * +2.724946e-02f + r[18] * -3.385706e-02f + r[19] * +4.295093e-02f
-					     + r[20] * -5.647748e-02f + r[21] * +7.922398e-02f + r[22] * -1.269367e-01f + r[23] * +2.993829e-01f
-					     + r[24] * +9.000753e-01f + r[25] * -1.788607e-01f + r[26] * +9.788141e-02f + r[27] * -6.616853e-02f
-					     + r[28] * +4.896667e-02f + r[29] * -3.800644e-02f + r[30] * +3.031531e-02f + r[31] * -2.456432e-02f
-					     + r[32] * +2.007155e-02f + r[33] * -1.645206e-02f + r[34] * +1.347264e-02f + r[35] * -1.098403e-02f
-					     + r[36] * +8.886314e-03f + r[37] * -7.109989e-03f + r[38] * +5.604985e-03f + r[39] * -4.334012e-03f
-					     + r[40] * +3.268371e-03f + r[41] * -2.385230e-03f + r[42] * +1.665807e-03f + r[43] * -1.094138e-03f
-					     + r[44] * +6.562235e-04f + r[45] * -3.394408e-04f + r[46] * +1.321291e-04f + r[47] * -2.330790e-05f;
-					/* clang-format on */
-
-					for (int i = 0; i < 47; ++i) {
-						r[i] = r[i + 1];
-					}
-
-					float p1 = std::max (fabsf (u[0]), fabsf (u[1]));
-					float p2 = std::max (fabsf (u[2]), fabsf (u[3]));
-					x        = std::max (p1, p2);
-
-				} else {
-					x = fabsf (x);
-				}
+		/* complete chunks use a constant length */
+		const int n = (_c1 == Div1 && nframes >= Div1) ? Div1 : ((_c1 < nframes) ? _c1 : nframes);
 
-				if (isgreater (x, m1)) {
-					m1 = x;
-				}
-				x = fabsf (z);
-				if (isgreater (x, m2)) {
-					m2 = x;
-				}
+		float g = _g0;
+		for (int j = 0; j < nchan; j++) {
+			if (Env) {
+				float* q = inp[j] + k;
+				g        = _kern->gain_ramp (q, 0, q, n, _g0, _dg);
+				m1       = _kern->peak_scan (q, n, m1);
+			} else {
+				float* q = _dbuff[j] + wi;
+				g        = _kern->gain_ramp (q, _dsize, inp[j] + k, n, _g0, _dg);
+				m1       = _kern->peak_scan (q, n, m1);
 			}
-			_zlf[j] = isfinite (z) ? z : 0.f;
+		}
+		if (Env) {
+			m2 = lpf_peak<NChan> (inp, k, n, m2);
+		} else {
+			m2 = lpf_peak<NChan> (_dbuff, wi, n, m2);
 		}
 		_g0 = g;
 
 		_c1 -= n;
-		if (_c1 == 0) {
+		const bool done = _c1 == 0;
+		if (done) {
+			if (_nramp) {
+				if (--_nramp == 0) {
+					_gt = _gt1;
+					_w3 = _w31;
+				} else {
+					_gt *= _rgt;
+					_w3 *= _rw3;
+				}
+				w3 = _w3;
+			}
+			if (TruePeak) {
+				/* true-peak of the complete chunk of gained input.
+				 * The upsampler's history precedes the chunk in the delay-line,
+				 * the mirrored half always has it in front.
+				 */
+				float* const* d  = Env ? inp : _dbuff;
+				const int     ci = Env ? k + n - Div1 : wi + n - Div1 + _dsize;
+				if (_tplazy) {
+					/* skip the interpolation if the result cannot reach the threshold */
+					const float lim = 1.f / _gt;
+					for (int j = 0; j < nchan; j++) {
+						float x;
+						if (_upsampler.process (d[j] + ci, Div1, lim, &x)) {
+							++_tpskip;
+						}
+						if (isgreater (x, m1)) {
+							m1 = x;
+						}
+					}
+				} else {
+					for (int j = 0; j < nchan; j++) {
+						const float x = _upsampler.process (d[j] + ci, Div1);
+						if (isgreater (x, m1)) {
+							m1 = x;
+						}
+					}
+				}
+				_tpchunks += nchan;
+			}
 			m1 *= _gt;
 			if (m1 > pk) {
 				pk = m1;
@@ -342,7 +889,7 @@ Peaklim::process (int nframes, float* inp[], float* out[])
 			h1  = (m1 > 1.f) ? 1.f / m1 : 1.f;
 			h1  = _hist1.write (h1);
 			m1  = 0;
-			_c1 = _div1;
+			_c1 = Div1;
 			if (--_c2 == 0) {
 				m2 *= _gt;
 				h2  = (m2 > 1.f) ? 1.f / m2 : 1.f;
@@ -354,33 +901,60 @@ Peaklim::process (int nframes, float* inp[], float* out[])
 					_g0 = _g1;
 					_dg = 0;
 				} else {
-					_dg /= _div1 * _div2 * _div2;
+					_dg /= Div1 * _div2 * _div2;
 				}
 			}
 		}
 
+		/* h1, h2 are constant within a chunk, so z1, z2 are
+		 * exponential curves and can be computed in parallel.
+		 */
+		float*      gv = Env ? out[0] + k : _gbuf;
+		const float d1 = z1 - h1;
+		const float d2 = z2 - h2;
+		for (int i = 0; i < n; i++) {
+			const float a = h1 + d1 * _pw1[i];
+			const float b = h2 + d2 * _pw2[i];
+			gv[i]         = (b < a) ? b : a;
+		}
+		z1 = h1 + d1 * _pw1[n - 1];
+		z2 = h2 + d2 * _pw2[n - 1];
+
+		/* attack/release is non-linear and remains sequential */
 		for (int i = 0; i < n; i++) {
-			z1 += _w1 * (h1 - z1);
-			z2 += _w2 * (h2 - z2);
-			const float z = (z2 < z1) ? z2 : z1;
+			const float z = gv[i];
 			if (z < z3) {
-				z3 += _w1 * (z - z3);
+				z3 += w1 * (z - z3);
 			} else {
-				z3 += _w3 * (z - z3);
+				z3 += w3 * (z - z3);
 			}
-			if (z3 > t1) {
-				t1 = z3;
-			}
-			if (z3 < t0) {
-				t0 = z3;
-			}
-			for (int j = 0; j < _nchan; j++) {
-				out[j][k + i] = z3 * _dbuff[j][ri + i];
+			gv[i] = z3;
+		}
+
+		for (int i = 0; i < n; i++) {
+			t1 = (gv[i] > t1) ? gv[i] : t1;
+			t0 = (gv[i] < t0) ? gv[i] : t0;
+		}
+
+		len += n;
+		if (done) {
+			/* publish the chunk, or keep accumulating while the ring is full */
+			const PeaklimStats st = { _spos + k + n, len, pk, t0, t1 };
+			if (_stats.push (st)) {
+				pk  = 0.f;
+				t0  = 1.f;
+				t1  = 0.f;
+				len = 0;
 			}
 		}
 
-		wi = (wi + n) & _dmask;
-		ri = (ri + n) & _dmask;
+		if (!Env) {
+			/* apply gain to all channels */
+			_kern->gain_apply (out, k, _dbuff, ri, nchan, gv, n);
+
+			wi = (wi + n) & _dmask;
+			ri = (ri + n) & _dmask;
+		}
 		k += n;
 		nframes -= n;
 	}
@@ -392,8 +966,11 @@ Peaklim::process (int nframes, float* inp[], float* out[])
 	_z2 = z2;
 	_z3 = z3;
 
-	_delri = ri;
-	_peak  = pk;
-	_gmin  = t0;
-	_gmax  = t1;
+	_delri   = ri;
+	_running = true;
+	_spos += k;
+	_slen  = len;
+	_speak = pk;
+	_sgmin = t0;
+	_sgmax = t1;
 }
@@ -19,21 +19,24 @@
 #ifndef _PEAKLIM_H
 #define _PEAKLIM_H
 
+#include <atomic>
 #include <stdint.h>
 
+#include "kernels.h"
+#include "upsampler.h"
+
 namespace DPLLV2
 {
 class Histmin
 {
 public:
-	Histmin (void)
-	{
-	}
-	~Histmin (void)
-	{
-	}
+	Histmin (void);
+	~Histmin (void);
 
-	void  init (int hlen);
+	/* maxlen: largest window length set_length () may use */
+	void  init (int hlen, int maxlen = 0);
+	void  set_length (int hlen);
+	void  reset (void);
 	float write (float v);
 	float
 	vmin (void)
@@ -42,73 +45,301 @@ public:
 	}
 
 private:
-	enum { SIZE = 32,
+	/* Minimum of the last _hlen values, kept in a ring-buffer of
+	 * (value, time) pairs with strictly increasing values. Every value
+	 * is added and removed once, write() is amortized O(1) and never
+	 * touches more than _hlen entries.
+	 */
+	int       _hlen;
+	uint32_t  _mask;
+	uint32_t  _rd, _wr;
+	uint32_t  _time;
+	float     _vmin;
+	float*    _hval;
+	uint32_t* _htim;
+};
+
+/* Statistics of one chunk of Peaklim::process (), or of several
+ * consecutive chunks if the ring was full.
+ */
+struct PeaklimStats {
+	uint64_t pos;  // sample position at the end, counted from init ()
+	uint32_t len;  // number of samples
+	float    peak; // input peak, relative to the threshold
+	float    gmin; // gain minimum
+	float    gmax; // gain maximum
+};
+
+/* Single producer, single consumer lock-free ring.
+ * The indices and the records are on separate cache-lines, so that
+ * the process thread does not share one with a reader.
+ */
+class StatsRing
+{
+public:
+	enum { SIZE = 512,
 	       MASK = SIZE - 1 };
 
-	int   _hlen;
-	int   _hold;
-	int   _wind;
-	float _vmin;
-	float _hist[SIZE];
+	StatsRing (void)
+	    : _wr (0)
+	    , _rd (0)
+	{
+	}
+
+	/* not thread-safe, call when neither side is active */
+	void
+	reset (void)
+	{
+		_wr.store (0, std::memory_order_relaxed);
+		_rd.store (0, std::memory_order_relaxed);
+	}
+
+	/* producer, returns false if the ring is full */
+	bool
+	push (const PeaklimStats& s)
+	{
+		const uint32_t w = _wr.load (std::memory_order_relaxed);
+		if (w - _rd.load (std::memory_order_acquire) >= SIZE) {
+			return false;
+		}
+		_buf[w & MASK] = s;
+		_wr.store (w + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* consumer, returns false if the ring is empty */
+	bool
+	pop (PeaklimStats* s)
+	{
+		const uint32_t r = _rd.load (std::memory_order_relaxed);
+		if (r == _wr.load (std::memory_order_acquire)) {
+			return false;
+		}
+		*s = _buf[r & MASK];
+		_rd.store (r + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::atomic<uint32_t> _wr __attribute__ ((aligned (64)));
+	std::atomic<uint32_t> _rd __attribute__ ((aligned (64)));
+	PeaklimStats          _buf[SIZE] __attribute__ ((aligned (64)));
 };
 
 class Peaklim
 {
 public:
-	enum { MAXCHAN = 2 };
+	static const float MINLOOKAHEAD;
+	static const float MAXLOOKAHEAD;
+	static const float RAMPTIME;
+	static const float BYPASSTIME;
 
 	Peaklim (void);
 	~Peaklim (void);
 
-	void init (float fsamp, int nchan);
+	/* isa: one of KernelISA, KERNEL_AUTO selects the best available one */
+	void init (float fsamp, int nchan, int isa = KERNEL_AUTO);
 	void fini (void);
 
+	/* These only compute coefficients if the value changed. Once
+	 * process () was called, threshold and release changes ramp
+	 * over RAMPTIME, the input-gain is always smoothed.
+	 */
 	void set_inpgain (float);
 	void set_threshold (float);
 	void set_release (float);
 	void set_truepeak (bool);
 
+	/* Bypass, with constant latency: the input is delayed by the
+	 * look-ahead. The output is crossfaded over BYPASSTIME, after
+	 * the limiter (when enabling) or the dry delay-line (when
+	 * bypassing) has been filled. When bypassed, process () only
+	 * copies the input through the dry delay-line.
+	 */
+	void set_bypass (bool);
+
+	/* look-ahead in ms, [MINLOOKAHEAD, MAXLOOKAHEAD], default 1.2ms.
+	 * The delay-line is allocated for the maximum: this does not
+	 * allocate and may be called from the process thread.
+	 * The latency changes accordingly (see get_latency).
+	 */
+	void set_lookahead (float ms);
+
+	/* look-ahead [ms] in chunks of div1 samples. With true-peak
+	 * the latency is at least Upsampler::NTAPS / 2 + 2 * div1
+	 * samples (0.91ms at 44.1kHz, 0.67ms at 96kHz, 0.5ms at 192kHz).
+	 */
+	static int lookahead_chunks (float ms, float fsamp, int div1, bool truepeak);
+
+	/* Skip the true-peak interpolation of chunks whose sample-peak is
+	 * too far below the threshold to reach it (default: on).
+	 * This does not change the gain, only the reported peak of those
+	 * chunks is the sample-peak.
+	 */
+	void set_truepeak_lazy (bool);
+
 	int
 	get_latency () const
 	{
 		return _delay;
 	}
 
+	/* Samples after which the gain no longer depends on the state
+	 * before, within the given tolerance: the delay-line and the
+	 * hold (history minimum) windows are refilled, and the filters
+	 * and release envelope have decayed. Depends on look-ahead and
+	 * release time.
+	 */
+	int get_settle_time (float tolerance) const;
+
+	const char*
+	kernel_name () const
+	{
+		return _kern->name;
+	}
+
+	/* Statistics of the processed chunks, in order; one record per
+	 * chunk (8..32 samples depending on the sample-rate). If they are
+	 * not read, records are merged until there is space again, no
+	 * samples are lost. Lock-free, may be called from another thread
+	 * than process (), but only from one.
+	 */
+	bool
+	read_stats (PeaklimStats* s)
+	{
+		return _stats.pop (s);
+	}
+
+	/* true-peak chunks (per channel) since init, and how many
+	 * of those skipped the interpolation.
+	 */
 	void
-	get_stats (float* peak, float* gmax, float* gmin)
+	get_truepeak_stats (uint64_t* chunks, uint64_t* skipped) const
 	{
-		*peak  = _peak;
-		*gmax  = _gmax;
-		*gmin  = _gmin;
-		_rstat = true;
+		*chunks  = _tpchunks;
+		*skipped = _tpskip;
 	}
 
-	void process (int nsamp, float* inp[], float* out[]);
+	void
+	process (int nsamp, float* inp[], float* out[])
+	{
+		if (_bstate == BP_ACTIVE) {
+			(this->*_process) (nsamp, inp, out);
+		} else {
+			process_bypass (nsamp, inp, out);
+		}
+	}
+
+	/* Offline, two-pass: the gain only, without delay-line.
+	 * The input-gain is applied to x[] in place, and the gain for
+	 * each sample is written to gain[]. The output of process () is
+	 * the same as x[][i - latency] * gain[i].
+	 * With true-peak, Upsampler::NTAPS - 1 samples before x[c] must
+	 * be the preceding (gained) input.
+	 * Do not mix with process () calls.
+	 */
+	void
+	envelope (int nsamp, float* x[], float* gain)
+	{
+		(this->*_envelope) (nsamp, x, &gain);
+	}
 
 private:
+	enum { MAXDIV1 = 32 };
+
+	enum BypassState {
+		BP_ACTIVE,   // limiter only
+		BP_FILLDRY,  // limiter, filling the dry delay-line
+		BP_FADE,     // both, crossfade (_xfade: 0 limiter .. 1 dry)
+		BP_FILLWET,  // dry, filling the limiter's delay-line
+		BP_BYPASSED, // dry delay-line only
+	};
+
+	typedef void (Peaklim::*ProcessFn) (int, float*[], float*[]);
+
+	/* NChan == 0: any channel-count (_nchan)
+	 * Env: compute the gain only, see envelope ()
+	 */
+	template <bool TruePeak, int NChan, int Div1, bool Env>
+	void process_impl (int nsamp, float* inp[], float* out[]);
+
+	template <int NChan>
+	float lpf_peak (float* const* d, int off, int n, float m);
+
+	void select_process (void);
+	void start_ramp (void);
+
+	void  process_bypass (int nsamp, float* inp[], float* out[]);
+	void  process_at (int k, int n, float* inp[], float* out[]);
+	void  reset_gain (void);
+	void  dry_write (float* const* inp, int k, int n);
+	void  dry_read (float* const* out, int k, int n);
+	float dry_mix (float* const* out, int k, int n, float x, float dx);
+	void  stats_idle (int n);
+
+	const DSPKernels* _kern;
+	ProcessFn         _process;
+	ProcessFn         _envelope;
+
 	float          _fsamp;
 	int            _nchan;
 	int            _div1;
 	int            _div2;
 	int            _delay;
+	int            _dmax;
 	int            _dsize;
 	int            _dmask;
 	int            _delri;
-	float*         _dbuff[MAXCHAN];
+	float*         _dmem;
+	float**        _dbuff;
 	int            _c1, _c2;
 	float          _g0, _g1, _dg;
 	float          _gt, _m1, _m2;
 	float          _w1, _w2, _w3, _wlf;
+	float          _gt1, _w31, _rgt, _rw3;
+	int            _nramp, _ramplen;
+	bool           _running;
+	float          _vgain, _vthresh, _vrelease;
+	float          _vlookahead;
 	float          _z1, _z2, _z3;
-	float          _zlf[MAXCHAN];
-	float          _z[MAXCHAN][48];
-	volatile bool  _rstat;
-	volatile float _peak;
-	volatile float _gmax;
-	volatile float _gmin;
+	float*         _zlf;
+	Upsampler      _upsampler;
 	Histmin        _hist1;
 	Histmin        _hist2;
 	bool           _truepeak;
+	bool           _tplazy;
+	uint64_t       _tpchunks;
+	uint64_t       _tpskip;
+
+	/* statistics not yet in the ring */
+	uint64_t _spos;
+	uint32_t _slen;
+	float    _speak;
+	float    _sgmin;
+	float    _sgmax;
+
+	/* z1, z2 step response over a chunk: (1 - w)^(i + 1) */
+	float _pw1[MAXDIV1] __attribute__ ((aligned (64)));
+	float _pw2[MAXDIV1] __attribute__ ((aligned (64)));
+	/* gain curve of the current chunk */
+	float _gbuf[MAXDIV1] __attribute__ ((aligned (64)));
+
+	/* bypass, see process_bypass () */
+	BypassState _bstate;
+	bool        _bypass;
+	int         _bcnt;
+	float       _xfade;
+	float       _xstep;
+	int         _xsize;
+	int         _xmask;
+	int         _xseg;
+	int         _xwi;
+	float*      _xmem;
+	float**     _xbuff;
+	float**     _bin;
+	float**     _bout;
+
+	StatsRing _stats;
 };
 
 } // namespace
@@ -0,0 +1,945 @@
+/* x42-dpl-render -- offline peak limiter
+ *
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "peaklim.h"
+#include "wavfile.h"
+
+#ifndef VERSION
+#define VERSION "0"
+#endif
+
+using namespace DPLLV2;
+
+#define BLOCKSIZE 4096
+
+/* silence processed before the file, for the input-gain to settle */
+#define PREROLL 0.2 // seconds
+
+/* Gain difference at the start of a segment, compared to rendering
+ * the complete file in one go. Below this, rounding dominates: the
+ * release envelope stops moving when a step is less than half an ulp,
+ * i.e. within about 2^-24 / w3 of its target (3e-6 for 1 ms at 96k).
+ */
+#define SETTLE_TOLERANCE 1e-6f
+
+struct RenderOpts {
+	float       gain;
+	float       threshold;
+	float       release;
+	float       lookahead;
+	bool        truepeak;
+	int         format; // WAV_INVALID: same as input
+	bool        twopass;
+	float       segment; // seconds, 0: off
+	int         rawrate; // headerless input
+	int         rawchan; // 0: WAV
+	int         rawformat;
+	int         blocksize; // streaming
+	bool        mmap;
+	const char* outdir;
+	bool        verbose;
+};
+
+struct Job {
+	const char* inp;
+	char*       out;
+	WavWriter*  ww;      // shared by all segments, NULL: not segmented
+	int         pending; // tasks not yet done
+	double      duration; // audio, seconds
+	double      cputime;  // seconds
+	const char* error;    // NULL: success
+};
+
+/* a file, or a segment of it */
+struct Task {
+	Job*    job;
+	int64_t start; // first frame
+	int64_t end;   // -1: end of file
+	double  duration;
+};
+
+struct WorkQueue {
+	pthread_mutex_t   lock;
+	Task*             tasks;
+	int               ntasks;
+	int               next;
+	const RenderOpts* opts;
+};
+
+static double
+cputime (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double
+walltime (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static float
+clamp (float v, float lo, float hi)
+{
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+static bool
+same_file (const char* a, const char* b)
+{
+	struct stat sa, sb;
+	if (stat (a, &sa) || stat (b, &sb)) {
+		return false;
+	}
+	return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static bool
+open_input (WavReader* wr, const char* path, const RenderOpts* o)
+{
+	wr->set_mmap (o->mmap);
+	if (o->rawchan > 0) {
+		return wr->open_raw (path, o->rawrate, o->rawchan, o->rawformat);
+	}
+	return wr->open (path);
+}
+
+/* create the output for the complete input file */
+static bool
+open_output (WavWriter* ww, const char* path, const WavReader* wr, const RenderOpts* o)
+{
+	bool      ok;
+	const int fmt = o->format != WAV_INVALID ? o->format : wr->format ();
+	ww->set_mmap (o->mmap);
+	if (o->rawchan > 0) {
+		ok = ww->open_raw (path, wr->channels (), fmt);
+	} else {
+		ok = ww->open (path, wr->rate (), wr->channels (), fmt);
+	}
+	return ok && ww->set_length (wr->frames ());
+}
+
+static Peaklim*
+new_limiter (int rate, int nchan, const RenderOpts* o)
+{
+	Peaklim* p = new Peaklim ();
+	p->init (rate, nchan);
+	p->set_inpgain (o->gain);
+	p->set_threshold (o->threshold);
+	p->set_release (o->release);
+	p->set_truepeak (o->truepeak);
+	p->set_lookahead (o->lookahead);
+	return p;
+}
+
+/* Limit a file, or the segment [start, end) of it.
+ *
+ * The output is aligned with the input: output produced at position
+ * `pos` is frame `pos - latency` of the file. The input is zero-padded
+ * at the end to flush the delay-line, so that the output has the same
+ * length as the input.
+ *
+ * The limiter is always called with complete blocks, counted from the
+ * start of the file: the gain curve of a chunk that is split across
+ * process calls depends on where it is split. A segment starts reading
+ * at a block boundary, early enough for the limiter to settle, and then
+ * produces the same output as rendering the complete file.
+ *
+ * Float data is used directly from the memory-mapped files when
+ * possible, mono input is not even copied.
+ */
+static bool
+render (Task* t, const RenderOpts* o, const char** err)
+{
+	Job*       job = t->job;
+	WavReader  wr;
+	WavWriter  ww;
+	WavWriter* w = job->ww ? job->ww : &ww;
+
+	if (!job->ww && same_file (job->inp, job->out)) {
+		*err = "output is the input file";
+		return false;
+	}
+
+	if (!open_input (&wr, job->inp, o)) {
+		*err = wr.error ();
+		return false;
+	}
+
+	const int     nchan  = wr.channels ();
+	const int64_t frames = wr.frames ();
+	const int64_t start  = t->start;
+	const int64_t end    = t->end < 0 ? frames : t->end;
+
+	if (!job->ww && !open_output (&ww, job->out, &wr, o)) {
+		*err = ww.error ();
+		return false;
+	}
+
+	Peaklim* p = new_limiter (wr.rate (), nchan, o);
+
+	const int latency = p->get_latency ();
+
+	/* Two-pass: the input is kept (without delay-line) for `hist`
+	 * samples, for the output and the true-peak upsampler.
+	 */
+	const DSPKernels* kern = dsp_kernels (KERNEL_AUTO);
+	int               hist = 0;
+	if (o->twopass) {
+		hist = latency > Upsampler::NTAPS - 1 ? latency : Upsampler::NTAPS - 1;
+		hist = (hist + 31) & ~31;
+	}
+
+	float*  buf  = new float[BLOCKSIZE * nchan];
+	float*  gain = new float[BLOCKSIZE];
+	float** inp  = new float*[nchan];
+	float** out  = new float*[nchan];
+	float** x    = new float*[nchan];
+	for (int c = 0; c < nchan; ++c) {
+		inp[c] = new float[hist + BLOCKSIZE];
+		out[c] = new float[BLOCKSIZE];
+		x[c]   = inp[c] + hist;
+		memset (inp[c], 0, (hist + BLOCKSIZE) * sizeof (float));
+	}
+
+	/* the gain ramps from unity to the input-gain, on silence
+	 * this has no effect other than settling the gain.
+	 */
+	for (int64_t n = PREROLL * wr.rate (); n > 0; n -= BLOCKSIZE) {
+		if (o->twopass) {
+			p->envelope (BLOCKSIZE, x, gain);
+		} else {
+			p->process (BLOCKSIZE, x, out);
+		}
+	}
+
+	int64_t pos = start - p->get_settle_time (SETTLE_TOLERANCE);
+	pos         = pos > 0 ? pos - pos % BLOCKSIZE : 0;
+
+	bool ok = wr.seek (pos);
+	if (!ok) {
+		*err = "seek error";
+	}
+
+	while (ok && pos < end + latency) {
+		int64_t n = frames - pos;
+		n         = n < 0 ? 0 : n > BLOCKSIZE ? BLOCKSIZE : n;
+		const float* src = n > 0 ? wr.map (pos) : NULL;
+		if (n > 0 && !src) {
+			if (wr.read (buf, n) != n) {
+				*err = "read error";
+				ok   = false;
+				break;
+			}
+			src = buf;
+		}
+
+		if (nchan == 1 && n == BLOCKSIZE && src != buf && !o->twopass) {
+			/* process () does not modify the input, use the mapping */
+			float* m[1] = { const_cast<float*> (src) };
+			p->process (BLOCKSIZE, m, out);
+		} else {
+			for (int c = 0; c < nchan; ++c) {
+				for (int i = 0; i < n; ++i) {
+					x[c][i] = src[i * nchan + c];
+				}
+				if (n < BLOCKSIZE) {
+					memset (x[c] + n, 0, (BLOCKSIZE - n) * sizeof (float));
+				}
+			}
+			if (o->twopass) {
+				/* 1st pass: gain, the input-gain is applied to x in place.
+				 * 2nd pass: apply the gain to the input `latency` samples ago.
+				 */
+				p->envelope (BLOCKSIZE, x, gain);
+				for (int i = 0; i < BLOCKSIZE; i += 32) {
+					kern->gain_apply (out, i, inp, hist - latency + i, nchan, gain + i, 32);
+				}
+				for (int c = 0; c < nchan; ++c) {
+					memcpy (inp[c], inp[c] + BLOCKSIZE, hist * sizeof (float));
+				}
+			} else {
+				p->process (BLOCKSIZE, x, out);
+			}
+		}
+
+		/* out[c][i] is frame f0 + i */
+		const int64_t f0 = pos - latency;
+		const int64_t i0 = start > f0 ? start - f0 : 0;
+		const int64_t i1 = end < f0 + BLOCKSIZE ? end - f0 : BLOCKSIZE;
+
+		if (i1 > i0) {
+			float* dst = w->map (f0 + i0);
+			if (!dst) {
+				dst = buf;
+			}
+			for (int c = 0; c < nchan; ++c) {
+				for (int i = i0; i < i1; ++i) {
+					dst[(i - i0) * nchan + c] = out[c][i];
+				}
+			}
+			if (dst == buf && !w->write_at (f0 + i0, buf, i1 - i0)) {
+				*err = "write error";
+				ok   = false;
+			}
+		}
+		pos += BLOCKSIZE;
+	}
+
+	if (!job->ww) {
+		if (!ww.close () && ok) {
+			*err = ww.error ();
+			ok   = false;
+		}
+		if (!ok) {
+			unlink (job->out);
+		}
+	}
+
+	t->duration = (end - start) / (double)wr.rate ();
+
+	for (int c = 0; c < nchan; ++c) {
+		delete[] inp[c];
+		delete[] out[c];
+	}
+	delete[] inp;
+	delete[] out;
+	delete[] x;
+	delete[] buf;
+	delete[] gain;
+	delete p;
+
+	return ok;
+}
+
+static void*
+worker (void* arg)
+{
+	WorkQueue* q = (WorkQueue*)arg;
+
+	while (true) {
+		pthread_mutex_lock (&q->lock);
+		Task* t = q->next < q->ntasks ? &q->tasks[q->next++] : NULL;
+		pthread_mutex_unlock (&q->lock);
+
+		if (!t) {
+			break;
+		}
+
+		Job*         job = t->job;
+		const char*  err = "";
+		const double t0  = cputime ();
+		const bool   ok  = render (t, q->opts, &err);
+		const double dt  = cputime () - t0;
+
+		pthread_mutex_lock (&q->lock);
+		job->cputime += dt;
+		if (ok) {
+			job->duration += t->duration;
+		} else if (!job->error) {
+			job->error = err;
+		}
+		const bool done = --job->pending == 0;
+		pthread_mutex_unlock (&q->lock);
+
+		if (!done) {
+			continue;
+		}
+
+		/* last segment, no other thread uses the job */
+		if (job->ww) {
+			if (!job->ww->close () && !job->error) {
+				job->error = job->ww->error ();
+			}
+			if (job->error) {
+				unlink (job->out);
+			}
+			delete job->ww;
+			job->ww = NULL;
+		}
+
+		pthread_mutex_lock (&q->lock);
+		if (job->error) {
+			fprintf (stderr, "%s: %s\n", job->inp, job->error);
+		} else if (q->opts->verbose) {
+			printf ("%s -> %s: %.1f sec, realtime x%.1f\n", job->inp, job->out,
+			        job->duration, job->duration / (job->cputime > 0 ? job->cputime : 1e-9));
+		}
+		pthread_mutex_unlock (&q->lock);
+	}
+	return NULL;
+}
+
+static int64_t
+segment_length (const RenderOpts* o, int rate)
+{
+	int64_t seglen = o->segment * rate;
+	return (seglen / BLOCKSIZE + 1) * BLOCKSIZE;
+}
+
+/* Split a file into segments of about o->segment seconds: prepare the output
+ * and add one task per segment. Returns the number of tasks added.
+ */
+static int
+split (Job* job, const RenderOpts* o, Task* tasks)
+{
+	WavReader wr;
+	if (!open_input (&wr, job->inp, o)) {
+		job->error = wr.error ();
+		return 0;
+	}
+
+	const int64_t seglen = segment_length (o, wr.rate ());
+
+	if (wr.frames () <= seglen) {
+		tasks[0].job   = job;
+		tasks[0].start = 0;
+		tasks[0].end   = -1;
+		return 1;
+	}
+
+	if (same_file (job->inp, job->out)) {
+		job->error = "output is the input file";
+		return 0;
+	}
+
+	job->ww = new WavWriter ();
+	if (!open_output (job->ww, job->out, &wr, o)) {
+		job->error = job->ww->error ();
+		delete job->ww;
+		job->ww = NULL;
+		return 0;
+	}
+
+	int n = 0;
+	for (int64_t s = 0; s < wr.frames (); s += seglen, ++n) {
+		tasks[n].job   = job;
+		tasks[n].start = s;
+		tasks[n].end   = s + seglen < wr.frames () ? s + seglen : wr.frames ();
+	}
+	return n;
+}
+
+/* Let a pipe hold a complete block, so that a block is moved
+ * with a single read or write, and the other process can continue.
+ */
+static void
+pipe_size (int fd, int size)
+{
+#ifdef F_SETPIPE_SZ
+	if (fcntl (fd, F_GETPIPE_SZ) < size) {
+		fcntl (fd, F_SETPIPE_SZ, size);
+	}
+#endif
+}
+
+/* read complete frames, until n frames or EOF.
+ * At EOF, *partial is set to the number of bytes of an incomplete
+ * last frame, which is not returned.
+ */
+static int
+read_frames (int fd, uint8_t* buf, int n, int bpf, bool* eof, int* partial)
+{
+	size_t       len = 0;
+	const size_t max = (size_t)n * bpf;
+	while (len < max) {
+		ssize_t rv = read (fd, buf + len, max - len);
+		if (rv < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rv < 0) {
+			return -1;
+		}
+		if (rv == 0) {
+			*eof     = true;
+			*partial = len % bpf;
+			break;
+		}
+		len += rv;
+	}
+	return len / bpf;
+}
+
+static bool
+write_all (int fd, const uint8_t* buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t rv = write (fd, buf, len);
+		if (rv < 0 && errno == EINTR) {
+			continue;
+		}
+		if (rv <= 0) {
+			return false;
+		}
+		buf += rv;
+		len -= rv;
+	}
+	return true;
+}
+
+/* Filter raw PCM from stdin to stdout.
+ *
+ * Like render (), the output is aligned with the input and has the same
+ * length: the first `latency` samples are skipped, and at EOF the input is
+ * zero-padded to drain the delay-line. The limiter is called with complete
+ * blocks (a multiple of 32 samples), so the result does not depend on how
+ * the input arrives.
+ */
+static int
+stream (const RenderOpts* o)
+{
+	const int nchan = o->rawchan;
+	const int ifmt  = o->rawformat;
+	const int ofmt  = o->format != WAV_INVALID ? o->format : ifmt;
+	const int ibpf  = nchan * wav_format_bytes (ifmt);
+	const int obpf  = nchan * wav_format_bytes (ofmt);
+	const int bs    = o->blocksize;
+
+	Peaklim*  p       = new_limiter (o->rawrate, nchan, o);
+	const int latency = p->get_latency ();
+
+	pipe_size (0, bs * ibpf);
+	pipe_size (1, bs * obpf);
+
+	uint8_t* iraw = (uint8_t*)malloc ((size_t)bs * ibpf);
+	uint8_t* oraw = (uint8_t*)malloc ((size_t)bs * obpf);
+	float*   buf  = new float[bs * nchan];
+	float**  inp  = new float*[nchan];
+	float**  out  = new float*[nchan];
+	for (int c = 0; c < nchan; ++c) {
+		inp[c] = new float[bs];
+		out[c] = new float[bs];
+		memset (inp[c], 0, bs * sizeof (float));
+	}
+
+	for (int64_t n = PREROLL * o->rawrate; n > 0; n -= bs) {
+		p->process (bs, inp, out);
+	}
+
+	int64_t     pos     = 0; // processed frames
+	int64_t     nin     = 0; // frames read
+	bool        eof     = false;
+	int         partial = 0;
+	const char* err     = NULL;
+
+	while (!eof || pos < nin + latency) {
+		int n = 0;
+		if (!eof && (n = read_frames (0, iraw, bs, ibpf, &eof, &partial)) < 0) {
+			err = strerror (errno);
+			break;
+		}
+		nin += n;
+
+		wav_decode (buf, iraw, n * nchan, ifmt);
+		for (int c = 0; c < nchan; ++c) {
+			for (int i = 0; i < n; ++i) {
+				inp[c][i] = buf[i * nchan + c];
+			}
+			if (n < bs) {
+				memset (inp[c] + n, 0, (bs - n) * sizeof (float));
+			}
+		}
+
+		p->process (bs, inp, out);
+
+		/* out[c][i] is input frame pos + i - latency */
+		const int64_t i0 = latency > pos ? latency - pos : 0;
+		const int64_t i1 = nin + latency < pos + bs ? nin + latency - pos : bs;
+		pos += bs;
+
+		if (i1 <= i0) {
+			continue;
+		}
+		for (int c = 0; c < nchan; ++c) {
+			for (int i = i0; i < i1; ++i) {
+				buf[(i - i0) * nchan + c] = out[c][i];
+			}
+		}
+		wav_encode (oraw, buf, (i1 - i0) * nchan, ofmt);
+		if (!write_all (1, oraw, (i1 - i0) * obpf)) {
+			err = strerror (errno);
+			break;
+		}
+	}
+
+	char msg[64];
+	if (!err && partial) {
+		/* the complete frames were processed, but this is likely the
+		 * wrong channel-count or sample format, or a truncated stream.
+		 */
+		snprintf (msg, sizeof (msg), "input ends with a partial frame (%d of %d bytes)", partial, ibpf);
+		err = msg;
+	}
+	if (err) {
+		fprintf (stderr, "x42-dpl-render: %s\n", err);
+	}
+
+	for (int c = 0; c < nchan; ++c) {
+		delete[] inp[c];
+		delete[] out[c];
+	}
+	delete[] inp;
+	delete[] out;
+	delete[] buf;
+	free (iraw);
+	free (oraw);
+	delete p;
+
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int
+parse_format (const char* s)
+{
+	if (!strcmp (s, "16")) {
+		return WAV_PCM16;
+	} else if (!strcmp (s, "24")) {
+		return WAV_PCM24;
+	} else if (!strcmp (s, "32")) {
+		return WAV_PCM32;
+	} else if (!strcmp (s, "float")) {
+		return WAV_FLOAT32;
+	} else if (!strcmp (s, "double")) {
+		return WAV_FLOAT64;
+	}
+	return -1;
+}
+
+static void
+usage (int status)
+{
+	printf ("x42-dpl-render - Offline Digital Peak Limiter.\n\n");
+	printf ("Usage: x42-dpl-render [ OPTIONS ] -o <dir> <file>...\n"
+	        "       x42-dpl-render [ OPTIONS ] -R <rate>:<chn> - < input > output\n\n");
+	printf ("Options:\n"
+	        " -g, --gain <dB>          input gain, -10..30 dB (default: 0)\n"
+	        " -t, --threshold <dB>     maximum output level, -10..0 dB (default: -1)\n"
+	        " -r, --release <sec>      release time, 0.001..1 sec (default: 0.01)\n"
+	        " -l, --lookahead <ms>     look-ahead, 0.25..10 ms (default: 1.2)\n"
+	        " -T, --truepeak           limit true-peak instead of sample-peak\n"
+	        " -2, --two-pass           compute the gain, then apply it (no delay-line)\n"
+	        " -f, --format <fmt>       output format: 16, 24, 32, float, double\n"
+	        "                          (default: same as input)\n"
+	        " -R, --raw <rate>:<chn>   input (and output) is headerless interleaved\n"
+	        "                          PCM, with the given rate and channels\n"
+	        " -i, --input-format <fmt> format of raw input: 16, 24, 32, float, double\n"
+	        "                          (default: float)\n"
+	        " -b, --blocksize <num>    frames per block when streaming (default: 4096)\n"
+	        " -M, --no-mmap            use buffered I/O instead of memory-mapping\n"
+	        " -j, --jobs <num>         number of files to process in parallel\n"
+	        "                          (default: number of CPUs)\n"
+	        " -s, --segment <sec>      split files longer than this into segments,\n"
+	        "                          which are processed in parallel (default: off)\n"
+	        " -o, --output <dir>       directory to write the output files to\n"
+	        " -q, --quiet              only print errors\n"
+	        " -h, --help               display this help and exit\n"
+	        " -V, --version            print version information and exit\n"
+	        "\n");
+	printf ("The files (WAV, RF64 or raw PCM) are limited with the same algorithm and\n"
+	        "parameters as the dpl.lv2 plugin, the latency is compensated: the output is\n"
+	        "aligned with and has the same length as the input. The output files have\n"
+	        "the same name as the input files, which therefore must be unique.\n"
+	        "\n"
+	        "With a single '-' as file, raw PCM is read from stdin and the limited\n"
+	        "signal is written to stdout, e.g. in a pipe between decoder and encoder.\n"
+	        "\n"
+	        "Segments overlap: each one starts early enough for the limiter to settle,\n"
+	        "depending on release-time and look-ahead. The result is the same as\n"
+	        "processing the file in one go, except for rounding (about -100 dBFS,\n"
+	        "less than one LSB of 16 bit output).\n"
+	        "\n"
+	        "Report bugs at <https://github.com/x42/dpl.lv2/issues>.\n");
+	exit (status);
+}
+
+static struct option const long_options[] = {
+	{ "gain", required_argument, 0, 'g' },
+	{ "threshold", required_argument, 0, 't' },
+	{ "release", required_argument, 0, 'r' },
+	{ "lookahead", required_argument, 0, 'l' },
+	{ "truepeak", no_argument, 0, 'T' },
+	{ "two-pass", no_argument, 0, '2' },
+	{ "format", required_argument, 0, 'f' },
+	{ "raw", required_argument, 0, 'R' },
+	{ "input-format", required_argument, 0, 'i' },
+	{ "blocksize", required_argument, 0, 'b' },
+	{ "no-mmap", no_argument, 0, 'M' },
+	{ "jobs", required_argument, 0, 'j' },
+	{ "segment", required_argument, 0, 's' },
+	{ "output", required_argument, 0, 'o' },
+	{ "quiet", no_argument, 0, 'q' },
+	{ "help", no_argument, 0, 'h' },
+	{ "version", no_argument, 0, 'V' },
+	{ NULL, 0, NULL, 0 }
+};
+
+int
+main (int argc, char** argv)
+{
+	RenderOpts o;
+	o.gain      = 0;
+	o.threshold = -1;
+	o.release   = 0.01;
+	o.lookahead = 1.2;
+	o.truepeak  = false;
+	o.format    = WAV_INVALID;
+	o.twopass   = false;
+	o.segment   = 0;
+	o.rawrate   = 0;
+	o.rawchan   = 0;
+	o.rawformat = WAV_FLOAT32;
+	o.blocksize = BLOCKSIZE;
+	o.mmap      = true;
+	o.outdir    = NULL;
+	o.verbose   = true;
+
+	int nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+
+	int c;
+	while ((c = getopt_long (argc, argv,
+	                         "g:" /* gain */
+	                         "t:" /* threshold */
+	                         "r:" /* release */
+	                         "l:" /* lookahead */
+	                         "T"  /* truepeak */
+	                         "2"  /* two-pass */
+	                         "f:" /* format */
+	                         "R:" /* raw */
+	                         "i:" /* input-format */
+	                         "b:" /* blocksize */
+	                         "M"  /* no-mmap */
+	                         "j:" /* jobs */
+	                         "s:" /* segment */
+	                         "o:" /* output */
+	                         "q"  /* quiet */
+	                         "h"  /* help */
+	                         "V", /* version */
+	                         long_options, (int*)0)) != EOF) {
+		switch (c) {
+			case 'g':
+				o.gain = clamp (atof (optarg), -10, 30);
+				break;
+			case 't':
+				o.threshold = clamp (atof (optarg), -10, 0);
+				break;
+			case 'r':
+				o.release = clamp (atof (optarg), 0.001, 1);
+				break;
+			case 'l':
+				o.lookahead = clamp (atof (optarg), Peaklim::MINLOOKAHEAD, Peaklim::MAXLOOKAHEAD);
+				break;
+			case 'T':
+				o.truepeak = true;
+				break;
+			case '2':
+				o.twopass = true;
+				break;
+			case 'f':
+				if ((o.format = parse_format (optarg)) < 0) {
+					fprintf (stderr, "Invalid output format '%s'\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'R':
+				if (sscanf (optarg, "%d:%d", &o.rawrate, &o.rawchan) != 2 || o.rawrate < 1 || o.rawchan < 1) {
+					fprintf (stderr, "Invalid raw format '%s', expected <rate>:<channels>\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'i':
+				if ((o.rawformat = parse_format (optarg)) < 0) {
+					fprintf (stderr, "Invalid input format '%s'\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'b':
+				/* complete chunks of the limiter */
+				o.blocksize = (atoi (optarg) + 31) & ~31;
+				o.blocksize = o.blocksize < 32 ? 32 : o.blocksize > 65536 ? 65536 : o.blocksize;
+				break;
+			case 'M':
+				o.mmap = false;
+				break;
+			case 'j':
+				nthreads = atoi (optarg);
+				break;
+			case 's':
+				o.segment = atof (optarg);
+				break;
+			case 'o':
+				o.outdir = optarg;
+				break;
+			case 'q':
+				o.verbose = false;
+				break;
+			case 'h':
+				usage (EXIT_SUCCESS);
+				break;
+			case 'V':
+				printf ("x42-dpl-render version %s\n\n", VERSION);
+				printf ("Copyright (C) GPL 2021 Robin Gareus <robin@gareus.org>\n");
+				exit (EXIT_SUCCESS);
+				break;
+			default:
+				usage (EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if (argc - optind == 1 && !strcmp (argv[optind], "-")) {
+		if (o.rawchan < 1) {
+			fprintf (stderr, "Streaming requires the raw format (-R)\n");
+			return EXIT_FAILURE;
+		}
+		return stream (&o);
+	}
+
+	if (optind >= argc || !o.outdir) {
+		usage (EXIT_FAILURE);
+	}
+
+	struct stat st;
+	if (stat (o.outdir, &st) || !S_ISDIR (st.st_mode)) {
+		fprintf (stderr, "Output directory '%s' does not exist\n", o.outdir);
+		return EXIT_FAILURE;
+	}
+
+	const int njobs = argc - optind;
+	Job*      jobs  = (Job*)calloc (njobs, sizeof (Job));
+
+	for (int i = 0; i < njobs; ++i) {
+		const char* inp  = argv[optind + i];
+		const char* base = strrchr (inp, '/');
+		base             = base ? base + 1 : inp;
+		jobs[i].inp      = inp;
+		jobs[i].out      = (char*)malloc (strlen (o.outdir) + strlen (base) + 2);
+		sprintf (jobs[i].out, "%s/%s", o.outdir, base);
+	}
+
+	/* inputs with the same name in different directories */
+	for (int i = 0; i < njobs; ++i) {
+		for (int j = 0; j < i; ++j) {
+			if (!strcmp (jobs[i].out, jobs[j].out)) {
+				fprintf (stderr, "'%s' and '%s' would both be written to '%s'\n",
+				         jobs[j].inp, jobs[i].inp, jobs[i].out);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	WorkQueue q;
+	q.ntasks = 0;
+	q.next   = 0;
+	q.opts   = &o;
+	q.tasks  = NULL;
+	pthread_mutex_init (&q.lock, NULL);
+
+	int maxtasks = 0;
+	for (int i = 0; i < njobs; ++i) {
+		int n = 1;
+		if (o.segment > 0) {
+			WavReader wr;
+			if (open_input (&wr, jobs[i].inp, &o)) {
+				n = 1 + wr.frames () / segment_length (&o, wr.rate ());
+			}
+		}
+		if (q.ntasks + n > maxtasks) {
+			maxtasks = 2 * (q.ntasks + n);
+			q.tasks  = (Task*)realloc (q.tasks, maxtasks * sizeof (Task));
+		}
+		if (o.segment > 0) {
+			n = split (&jobs[i], &o, &q.tasks[q.ntasks]);
+		} else {
+			q.tasks[q.ntasks].job   = &jobs[i];
+			q.tasks[q.ntasks].start = 0;
+			q.tasks[q.ntasks].end   = -1;
+		}
+		jobs[i].pending = n;
+		q.ntasks += n;
+		if (n == 0) {
+			fprintf (stderr, "%s: %s\n", jobs[i].inp, jobs[i].error);
+		}
+	}
+
+	if (nthreads > q.ntasks) {
+		nthreads = q.ntasks;
+	}
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+
+	pthread_t* threads = new pthread_t[nthreads];
+
+	const double t0 = walltime ();
+	int          nt = 0;
+	for (int i = 0; i < nthreads; ++i) {
+		if (pthread_create (&threads[nt], NULL, worker, &q) == 0) {
+			++nt;
+		}
+	}
+	if (nt == 0) {
+		worker (&q);
+	}
+	for (int i = 0; i < nt; ++i) {
+		pthread_join (threads[i], NULL);
+	}
+	const double wall = walltime () - t0;
+
+	double duration = 0;
+	double cpu      = 0;
+	int    failed   = 0;
+	for (int i = 0; i < njobs; ++i) {
+		if (!jobs[i].error) {
+			duration += jobs[i].duration;
+			cpu += jobs[i].cputime;
+		} else {
+			++failed;
+		}
+		free (jobs[i].out);
+	}
+
+	if (o.verbose && duration > 0) {
+		printf ("%d file(s), %.1f sec audio in %.2f sec using %d thread(s)\n",
+		        njobs - failed, duration, wall, nt > 0 ? nt : 1);
+		printf ("realtime factor: x%.1f per core, x%.1f total\n",
+		        duration / (cpu > 0 ? cpu : 1e-9), duration / (wall > 0 ? wall : 1e-9));
+	}
+
+	pthread_mutex_destroy (&q.lock);
+	delete[] threads;
+	free (q.tasks);
+	free (jobs);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
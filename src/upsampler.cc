@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.h"
+#include "upsampler.h"
+
+using namespace DPLLV2;
+
+Upsampler::Upsampler (void)
+    : _kern (dsp_kernels (KERNEL_SCALAR))
+    , _tpgain (tp_peak_gain () * 1.0001f) // margin for rounding
+{
+}
+
+void
+Upsampler::init (const DSPKernels* k)
+{
+	_kern = k;
+}
+
+float
+Upsampler::process (const float* x, int n) const
+{
+	return _kern->tp_peak (x - (NTAPS - 1), n);
+}
+
+bool
+Upsampler::process (const float* x, int n, float limit, float* peak) const
+{
+	/* The interpolated signal is bounded by the sample-peak of the
+	 * filter's window, history included. Check the new samples first,
+	 * loud blocks do not need to scan the history.
+	 */
+	const float u = _kern->peak_scan (x, n, 0);
+	if (u * _tpgain <= limit && _kern->peak_scan (x - (NTAPS - 1), NTAPS - 1, u) * _tpgain <= limit) {
+		*peak = u;
+		return true;
+	}
+	*peak = _kern->tp_peak (x - (NTAPS - 1), n);
+	return false;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UPSAMPLER_H
+#define _UPSAMPLER_H
+
+namespace DPLLV2
+{
+struct DSPKernels;
+
+/* 4x polyphase upsampler for true-peak analysis.
+ *
+ * The filter has no state of its own: the NTAPS - 1 samples preceding
+ * the input are its history, which the caller's buffer has to provide
+ * (the limiter's delay-line does). The whole block is convolved at
+ * once and only the peak of the interpolated signal is returned.
+ *
+ * The vectorized kernels sum in a different order than the
+ * scalar reference. The result matches within 1e-6 relative
+ * to the peak of the signal in the filter's window.
+ */
+class Upsampler
+{
+public:
+	enum { NTAPS = 48 };
+
+	Upsampler (void);
+
+	void init (const DSPKernels*);
+
+	/* x[-(NTAPS - 1) .. -1] is history, return the peak of
+	 * the 4x interpolated signal of x[0 .. n - 1]
+	 */
+	float process (const float* x, int n) const;
+
+	/* Same as above, unless the peak of the interpolated signal cannot
+	 * exceed `limit`: the interpolation is skipped and the peak of the
+	 * input samples is returned. Returns true if it was skipped.
+	 */
+	bool process (const float* x, int n, float limit, float* peak) const;
+
+private:
+	const DSPKernels* _kern;
+	float             _tpgain;
+};
+
+} // namespace
+
+#endif
@@ -21,10 +21,12 @@
 #ifdef HAVE_LV2_1_18_6
 #include <lv2/atom/atom.h>
 #include <lv2/atom/forge.h>
+#include <lv2/patch/patch.h>
 #include <lv2/urid/urid.h>
 #else
 #include <lv2/lv2plug.in/ns/ext/atom/atom.h>
 #include <lv2/lv2plug.in/ns/ext/atom/forge.h>
+#include <lv2/lv2plug.in/ns/ext/patch/patch.h>
 #include <lv2/lv2plug.in/ns/ext/urid/urid.h>
 #endif
 
@@ -44,15 +46,28 @@ typedef struct {
 	LV2_URID atom_Vector;
 	LV2_URID atom_Float;
 	LV2_URID atom_Int;
+	LV2_URID atom_URID;
 	LV2_URID atom_eventTransfer;
+	LV2_URID patch_Set;
+	LV2_URID patch_property;
+	LV2_URID patch_value;
+	LV2_URID p_gain;
+	LV2_URID p_threshold;
+	LV2_URID p_release;
 	LV2_URID history;
+	LV2_URID histdelta;
 	LV2_URID position;
+	LV2_URID sequence;
 	LV2_URID minvals;
 	LV2_URID maxvals;
 	LV2_URID ui_on;
 	LV2_URID ui_off;
 	LV2_URID state;
 	LV2_URID s_uiscale;
+	LV2_URID dspload;
+	LV2_URID dsp_mean;
+	LV2_URID dsp_peak;
+	LV2_URID dsp_unit;
 } PlimLV2URIs;
 
 static inline void
@@ -63,19 +78,38 @@ map_plim_uris (LV2_URID_Map* map, PlimLV2URIs* uris)
 	uris->atom_Vector        = map->map (map->handle, LV2_ATOM__Vector);
 	uris->atom_Float         = map->map (map->handle, LV2_ATOM__Float);
 	uris->atom_Int           = map->map (map->handle, LV2_ATOM__Int);
+	uris->atom_URID          = map->map (map->handle, LV2_ATOM__URID);
 	uris->atom_eventTransfer = map->map (map->handle, LV2_ATOM__eventTransfer);
+	uris->patch_Set          = map->map (map->handle, LV2_PATCH__Set);
+	uris->patch_property     = map->map (map->handle, LV2_PATCH__property);
+	uris->patch_value        = map->map (map->handle, LV2_PATCH__value);
+	uris->p_gain             = map->map (map->handle, PLIM_URI "gain");
+	uris->p_threshold        = map->map (map->handle, PLIM_URI "threshold");
+	uris->p_release          = map->map (map->handle, PLIM_URI "release");
 	uris->history            = map->map (map->handle, PLIM_URI "history");
+	uris->histdelta          = map->map (map->handle, PLIM_URI "histdelta");
 	uris->position           = map->map (map->handle, PLIM_URI "position");
+	uris->sequence           = map->map (map->handle, PLIM_URI "sequence");
 	uris->minvals            = map->map (map->handle, PLIM_URI "minvals");
 	uris->maxvals            = map->map (map->handle, PLIM_URI "maxvals");
 	uris->ui_on              = map->map (map->handle, PLIM_URI "ui_on");
 	uris->ui_off             = map->map (map->handle, PLIM_URI "ui_off");
 	uris->state              = map->map (map->handle, PLIM_URI "state");
 	uris->s_uiscale          = map->map (map->handle, PLIM_URI "uiscale");
+	uris->dspload            = map->map (map->handle, PLIM_URI "dspload");
+	uris->dsp_mean           = map->map (map->handle, PLIM_URI "dspmean");
+	uris->dsp_peak           = map->map (map->handle, PLIM_URI "dsppeak");
+	uris->dsp_unit           = map->map (map->handle, PLIM_URI "dspunit");
 }
 
 /* common definitions UI and DSP */
 
+/* unit of the DSP load, dspunit property of the dspload message */
+typedef enum {
+	DSP_UNIT_NS = 0, // nanoseconds
+	DSP_UNIT_TSC,    // x86 time-stamp counter, reference cycles
+} DSPUnit;
+
 typedef enum {
 	PLIM_ATOM_CONTROL = 0,
 	PLIM_ATOM_NOTIFY,
@@ -89,6 +123,8 @@ typedef enum {
 	PLIM_LEVEL,
 	PLIM_LATENCY,
 
+	/* audio: one input/output pair per channel,
+	 * channel c uses PLIM_INPUT0 + 2 * c and PLIM_OUTPUT0 + 2 * c */
 	PLIM_INPUT0,
 	PLIM_OUTPUT0,
 	PLIM_INPUT1,
@@ -96,4 +132,23 @@ typedef enum {
 	PLIM_LAST
 } PortIndex;
 
+/* Control ports that were added later follow the audio ports, so that
+ * existing ports keep their index. Their index depends on the number of
+ * channels, see plim_port_index (). The values here are the position in
+ * an array of control ports, after the ones above.
+ */
+typedef enum {
+	PLIM_LOOKAHEAD = PLIM_INPUT0,
+	/* time per sample, see WITH_DSPLOAD and DSPUnit */
+	PLIM_DSPLOAD,
+	PLIM_NCTRL
+} PortIndexExt;
+
+/* port index of a control port, PLIM_ENABLE .. PLIM_NCTRL - 1 */
+static inline uint32_t
+plim_port_index (uint32_t n_channels, uint32_t ctrl)
+{
+	return ctrl < PLIM_INPUT0 ? ctrl : ctrl + 2 * n_channels;
+}
+
 #endif
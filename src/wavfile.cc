@@ -0,0 +1,757 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "wavfile.h"
+
+using namespace DPLLV2;
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+#define DS64_SIZE 28
+
+/* float data in the file can be used as-is */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NATIVE_FLOAT32 1
+#else
+#define NATIVE_FLOAT32 0
+#endif
+
+/* KSDATAFORMAT_SUBTYPE_*, after the 16 bit format tag */
+static const uint8_t ksguid[14] = {
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+};
+
+/* little-endian helpers */
+
+static inline uint16_t
+get16 (const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+get32 (const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t
+get64 (const uint8_t* p)
+{
+	return get32 (p) | ((uint64_t)get32 (p + 4) << 32);
+}
+
+static inline void
+put16 (uint8_t* p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void
+put32 (uint8_t* p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline void
+put64 (uint8_t* p, uint64_t v)
+{
+	put32 (p, v);
+	put32 (p + 4, v >> 32);
+}
+
+int
+DPLLV2::wav_format_bytes (int fmt)
+{
+	switch (fmt) {
+		case WAV_PCM16:
+			return 2;
+		case WAV_PCM24:
+			return 3;
+		case WAV_PCM32:
+		case WAV_FLOAT32:
+			return 4;
+		case WAV_FLOAT64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+const char*
+DPLLV2::wav_format_name (int fmt)
+{
+	switch (fmt) {
+		case WAV_PCM16:
+			return "16 bit";
+		case WAV_PCM24:
+			return "24 bit";
+		case WAV_PCM32:
+			return "32 bit";
+		case WAV_FLOAT32:
+			return "32 bit float";
+		case WAV_FLOAT64:
+			return "64 bit float";
+		default:
+			return "invalid";
+	}
+}
+
+static int
+parse_format (int tag, int bits)
+{
+	if (tag == WAVE_FORMAT_PCM) {
+		switch (bits) {
+			case 16:
+				return WAV_PCM16;
+			case 24:
+				return WAV_PCM24;
+			case 32:
+				return WAV_PCM32;
+		}
+	} else if (tag == WAVE_FORMAT_IEEE_FLOAT) {
+		switch (bits) {
+			case 32:
+				return WAV_FLOAT32;
+			case 64:
+				return WAV_FLOAT64;
+		}
+	}
+	return WAV_INVALID;
+}
+
+void
+DPLLV2::wav_decode (float* dst, const uint8_t* src, int n, int fmt)
+{
+	switch (fmt) {
+		case WAV_PCM16:
+			for (int i = 0; i < n; ++i, src += 2) {
+				dst[i] = (int16_t)get16 (src) / 32768.f;
+			}
+			break;
+		case WAV_PCM24:
+			for (int i = 0; i < n; ++i, src += 3) {
+				const int32_t v = (uint32_t)src[0] << 8 | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24;
+				dst[i]          = (v >> 8) / 8388608.f;
+			}
+			break;
+		case WAV_PCM32:
+			for (int i = 0; i < n; ++i, src += 4) {
+				dst[i] = (int32_t)get32 (src) / 2147483648.f;
+			}
+			break;
+		case WAV_FLOAT32:
+			for (int i = 0; i < n; ++i, src += 4) {
+				uint32_t v = get32 (src);
+				memcpy (dst + i, &v, 4);
+			}
+			break;
+		case WAV_FLOAT64:
+			for (int i = 0; i < n; ++i, src += 8) {
+				uint64_t v = get64 (src);
+				double   d;
+				memcpy (&d, &v, 8);
+				dst[i] = d;
+			}
+			break;
+	}
+}
+
+void
+DPLLV2::wav_encode (uint8_t* dst, const float* src, int n, int fmt)
+{
+	switch (fmt) {
+		case WAV_PCM16:
+			for (int i = 0; i < n; ++i, dst += 2) {
+				float v = rintf (src[i] * 32768.f);
+				v       = v > 32767.f ? 32767.f : v < -32768.f ? -32768.f : v;
+				put16 (dst, (int16_t)v);
+			}
+			break;
+		case WAV_PCM24:
+			for (int i = 0; i < n; ++i, dst += 3) {
+				float v = rintf (src[i] * 8388608.f);
+				v       = v > 8388607.f ? 8388607.f : v < -8388608.f ? -8388608.f : v;
+				int32_t s = v;
+				dst[0]    = s;
+				dst[1]    = s >> 8;
+				dst[2]    = s >> 16;
+			}
+			break;
+		case WAV_PCM32:
+			for (int i = 0; i < n; ++i, dst += 4) {
+				double v = rint (src[i] * 2147483648.0);
+				v        = v > 2147483647.0 ? 2147483647.0 : v < -2147483648.0 ? -2147483648.0 : v;
+				put32 (dst, (uint32_t)(int32_t)v);
+			}
+			break;
+		case WAV_FLOAT32:
+			for (int i = 0; i < n; ++i, dst += 4) {
+				uint32_t v;
+				memcpy (&v, src + i, 4);
+				put32 (dst, v);
+			}
+			break;
+		case WAV_FLOAT64:
+			for (int i = 0; i < n; ++i, dst += 8) {
+				double   d = src[i];
+				uint64_t v;
+				memcpy (&v, &d, 8);
+				put64 (dst, v);
+			}
+			break;
+	}
+}
+
+/* ****************************************************************************/
+
+WavReader::WavReader (void)
+    : _f (0)
+    , _nchan (0)
+    , _rate (0)
+    , _fmt (WAV_INVALID)
+    , _bpf (0)
+    , _frames (0)
+    , _pos (0)
+    , _data (0)
+    , _raw (0)
+    , _rawlen (0)
+    , _use_map (true)
+    , _map (0)
+    , _maplen (0)
+    , _error ("")
+{
+}
+
+WavReader::~WavReader (void)
+{
+	close ();
+}
+
+bool
+WavReader::fail (const char* msg)
+{
+	_error = msg;
+	close ();
+	return false;
+}
+
+void
+WavReader::close (void)
+{
+	if (_map) {
+		munmap (_map, _maplen);
+	}
+	if (_f) {
+		fclose (_f);
+	}
+	free (_raw);
+	_f      = 0;
+	_raw    = 0;
+	_rawlen = 0;
+	_map    = 0;
+	_maplen = 0;
+}
+
+bool
+WavReader::open (const char* path)
+{
+	close ();
+	_error = "";
+	_fmt   = WAV_INVALID;
+
+	if (!(_f = fopen (path, "rb"))) {
+		return fail ("cannot open file");
+	}
+
+	uint8_t hdr[40];
+	if (fread (hdr, 1, 12, _f) != 12 || memcmp (hdr + 8, "WAVE", 4)) {
+		return fail ("not a WAVE file");
+	}
+
+	bool rf64;
+	if (!memcmp (hdr, "RIFF", 4)) {
+		rf64 = false;
+	} else if (!memcmp (hdr, "RF64", 4) || !memcmp (hdr, "BW64", 4)) {
+		rf64 = true;
+	} else {
+		return fail ("not a RIFF/RF64 file");
+	}
+
+	fseeko (_f, 0, SEEK_END);
+	const int64_t fsize = ftello (_f);
+	fseeko (_f, 12, SEEK_SET);
+
+	uint64_t ds64_data = 0;
+	int64_t  dsize     = -1;
+
+	/* iterate over chunks until "data" */
+	while (dsize < 0) {
+		if (fread (hdr, 1, 8, _f) != 8) {
+			return fail ("no data chunk");
+		}
+		uint64_t      csize = get32 (hdr + 4);
+		const int64_t cpos  = ftello (_f);
+
+		if (!memcmp (hdr, "ds64", 4)) {
+			if (csize < DS64_SIZE || fread (hdr, 1, 16, _f) != 16) {
+				return fail ("invalid ds64 chunk");
+			}
+			ds64_data = get64 (hdr + 8);
+		} else if (!memcmp (hdr, "fmt ", 4)) {
+			if (csize < 16 || fread (hdr, 1, csize < 40 ? csize : 40, _f) != (csize < 40 ? csize : 40)) {
+				return fail ("invalid fmt chunk");
+			}
+			int tag = get16 (hdr);
+			_nchan  = get16 (hdr + 2);
+			_rate   = get32 (hdr + 4);
+			if (tag == WAVE_FORMAT_EXTENSIBLE) {
+				if (csize < 40 || memcmp (hdr + 26, ksguid, 14)) {
+					return fail ("unsupported extensible format");
+				}
+				tag = get16 (hdr + 24);
+			}
+			_fmt = parse_format (tag, get16 (hdr + 14));
+		} else if (!memcmp (hdr, "data", 4)) {
+			_data = cpos;
+			if (rf64 && csize == 0xffffffff) {
+				csize = ds64_data;
+			}
+			dsize = csize;
+			/* header of an unfinished file, or truncated */
+			if (_data + dsize > fsize || dsize == 0) {
+				dsize = fsize - _data;
+			}
+			break;
+		}
+		fseeko (_f, cpos + csize + (csize & 1), SEEK_SET);
+	}
+
+	if (_fmt == WAV_INVALID) {
+		return fail ("unsupported sample format");
+	}
+	if (_nchan < 1 || _rate < 1) {
+		return fail ("invalid fmt chunk");
+	}
+	return finish (dsize);
+}
+
+bool
+WavReader::open_raw (const char* path, int rate, int nchan, int fmt)
+{
+	close ();
+	_error = "";
+	_fmt   = WAV_INVALID;
+
+	if (nchan < 1 || rate < 1 || wav_format_bytes (fmt) == 0) {
+		return fail ("invalid format");
+	}
+	if (!(_f = fopen (path, "rb"))) {
+		return fail ("cannot open file");
+	}
+	fseeko (_f, 0, SEEK_END);
+	const int64_t size = ftello (_f);
+	if (size % (nchan * wav_format_bytes (fmt))) {
+		/* most likely the wrong channel-count or sample format */
+		return fail ("size is not a multiple of the frame size");
+	}
+	_nchan = nchan;
+	_rate  = rate;
+	_fmt   = fmt;
+	_data  = 0;
+	return finish (size);
+}
+
+/* set up reading dsize bytes of data at _data */
+bool
+WavReader::finish (int64_t dsize)
+{
+	_bpf    = _nchan * wav_format_bytes (_fmt);
+	_frames = dsize / _bpf;
+	_pos    = 0;
+
+	const int64_t len = _data + _frames * _bpf;
+	if (_use_map && _frames > 0 && (uint64_t)len <= (size_t)-1) {
+		void* m = mmap (NULL, len, PROT_READ, MAP_SHARED, fileno (_f), 0);
+		if (m != MAP_FAILED) {
+			_map    = (uint8_t*)m;
+			_maplen = len;
+			madvise (_map, _maplen, MADV_SEQUENTIAL);
+			return true;
+		}
+	}
+	fseeko (_f, _data, SEEK_SET);
+	return true;
+}
+
+bool
+WavReader::seek (int64_t frame)
+{
+	if (!_f || frame < 0 || frame > _frames) {
+		return false;
+	}
+	if (!_map && fseeko (_f, _data + frame * _bpf, SEEK_SET)) {
+		return false;
+	}
+	_pos = frame;
+	return true;
+}
+
+const float*
+WavReader::map (int64_t frame) const
+{
+	if (!NATIVE_FLOAT32 || !_map || _fmt != WAV_FLOAT32 || frame < 0 || frame > _frames) {
+		return NULL;
+	}
+	const uint8_t* p = _map + _data + frame * _bpf;
+	return ((uintptr_t)p & 3) ? NULL : (const float*)p;
+}
+
+int
+WavReader::read (float* buf, int n)
+{
+	if (!_f) {
+		return 0;
+	}
+	if (n > _frames - _pos) {
+		n = _frames - _pos;
+	}
+	if (_map) {
+		wav_decode (buf, _map + _data + _pos * _bpf, n * _nchan, _fmt);
+		_pos += n;
+		return n;
+	}
+	if (n * _bpf > _rawlen) {
+		free (_raw);
+		_rawlen = n * _bpf;
+		_raw    = (uint8_t*)malloc (_rawlen);
+	}
+	n = fread (_raw, _bpf, n, _f);
+	wav_decode (buf, _raw, n * _nchan, _fmt);
+	_pos += n;
+	return n;
+}
+
+/* ****************************************************************************/
+
+WavWriter::WavWriter (void)
+    : _f (0)
+    , _nchan (0)
+    , _fmt (WAV_INVALID)
+    , _bpf (0)
+    , _hdrlen (0)
+    , _headerless (false)
+    , _frames (0)
+    , _raw (0)
+    , _rawlen (0)
+    , _use_map (true)
+    , _map (0)
+    , _maplen (0)
+    , _error ("")
+{
+}
+
+WavWriter::~WavWriter (void)
+{
+	if (_map) {
+		munmap (_map, _maplen);
+	}
+	if (_f) {
+		fclose (_f);
+	}
+	free (_raw);
+}
+
+bool
+WavWriter::fail (const char* msg)
+{
+	_error = msg;
+	if (_map) {
+		munmap (_map, _maplen);
+	}
+	if (_f) {
+		fclose (_f);
+	}
+	_f   = 0;
+	_map = 0;
+	return false;
+}
+
+/* RIFF header, JUNK (later ds64), fmt, data header */
+#define HDR_SIZE(FMTLEN) (12 + 8 + DS64_SIZE + 8 + (FMTLEN) + 8)
+
+static int
+fmt_size (int nchan, int fmt)
+{
+	return (nchan > 2 || fmt == WAV_PCM24 || fmt == WAV_PCM32) ? 40 : 16;
+}
+
+bool
+WavWriter::open (const char* path, int rate, int nchan, int fmt)
+{
+	if (_f) {
+		close ();
+	}
+	_error = "";
+
+	if (wav_format_bytes (fmt) == 0 || nchan < 1 || nchan > 0xffff) {
+		_error = "invalid format";
+		return false;
+	}
+
+	if (!(_f = fopen (path, "wb"))) {
+		_error = "cannot create file";
+		return false;
+	}
+
+	_nchan      = nchan;
+	_fmt        = fmt;
+	_bpf        = nchan * wav_format_bytes (fmt);
+	_frames     = 0;
+	_headerless = false;
+
+	const int fmtlen = fmt_size (nchan, fmt);
+	const int bits   = 8 * wav_format_bytes (fmt);
+	const int tag    = (fmt == WAV_FLOAT32 || fmt == WAV_FLOAT64) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+
+	uint8_t hdr[HDR_SIZE (40)];
+	memset (hdr, 0, sizeof (hdr));
+
+	uint8_t* p = hdr;
+	memcpy (p, "RIFF", 4);
+	memcpy (p + 8, "WAVE", 4);
+	p += 12;
+
+	memcpy (p, "JUNK", 4);
+	put32 (p + 4, DS64_SIZE);
+	p += 8 + DS64_SIZE;
+
+	memcpy (p, "fmt ", 4);
+	put32 (p + 4, fmtlen);
+	put16 (p + 8, fmtlen == 40 ? WAVE_FORMAT_EXTENSIBLE : tag);
+	put16 (p + 10, nchan);
+	put32 (p + 12, rate);
+	put32 (p + 16, rate * _bpf);
+	put16 (p + 20, _bpf);
+	put16 (p + 22, bits);
+	if (fmtlen == 40) {
+		put16 (p + 24, 22);
+		put16 (p + 26, bits);
+		put32 (p + 28, nchan == 1 ? 0x4 : nchan == 2 ? 0x3 : 0);
+		put16 (p + 32, tag);
+		memcpy (p + 34, ksguid, 14);
+	}
+	p += 8 + fmtlen;
+
+	memcpy (p, "data", 4);
+	p += 8;
+
+	_hdrlen = p - hdr;
+	if (fwrite (hdr, _hdrlen, 1, _f) != 1 || fflush (_f)) {
+		return fail ("write error");
+	}
+	return true;
+}
+
+bool
+WavWriter::open_raw (const char* path, int nchan, int fmt)
+{
+	if (_f) {
+		close ();
+	}
+	_error = "";
+
+	if (wav_format_bytes (fmt) == 0 || nchan < 1) {
+		_error = "invalid format";
+		return false;
+	}
+	if (!(_f = fopen (path, "wb"))) {
+		_error = "cannot create file";
+		return false;
+	}
+
+	_nchan      = nchan;
+	_fmt        = fmt;
+	_bpf        = nchan * wav_format_bytes (fmt);
+	_frames     = 0;
+	_hdrlen     = 0;
+	_headerless = true;
+	return true;
+}
+
+bool
+WavWriter::write (const float* buf, int n)
+{
+	if (!_f) {
+		return false;
+	}
+	if (n * _bpf > _rawlen) {
+		free (_raw);
+		_rawlen = n * _bpf;
+		_raw    = (uint8_t*)malloc (_rawlen);
+	}
+	wav_encode (_raw, buf, n * _nchan, _fmt);
+	if (fwrite (_raw, _bpf, n, _f) != (size_t)n) {
+		return fail ("write error");
+	}
+	_frames += n;
+	return true;
+}
+
+bool
+WavWriter::set_length (int64_t frames)
+{
+	if (_map) {
+		munmap (_map, _maplen);
+		_map = 0;
+	}
+	const int64_t len = _hdrlen + frames * _bpf;
+	if (!_f || fflush (_f) || ftruncate (fileno (_f), len)) {
+		return fail ("write error");
+	}
+	_frames = frames;
+
+	if (_use_map && frames > 0 && (uint64_t)len <= (size_t)-1) {
+		void* m = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fileno (_f), 0);
+		if (m != MAP_FAILED) {
+			_map    = (uint8_t*)m;
+			_maplen = len;
+			madvise (_map, _maplen, MADV_SEQUENTIAL);
+		}
+	}
+	return true;
+}
+
+float*
+WavWriter::map (int64_t frame) const
+{
+	if (!NATIVE_FLOAT32 || !_map || _fmt != WAV_FLOAT32 || frame < 0 || frame > _frames) {
+		return NULL;
+	}
+	uint8_t* p = _map + _hdrlen + frame * _bpf;
+	return ((uintptr_t)p & 3) ? NULL : (float*)p;
+}
+
+bool
+WavWriter::write_at (int64_t frame, const float* buf, int n)
+{
+	if (!_f || frame < 0 || frame + n > _frames) {
+		return false;
+	}
+	if (_map) {
+		wav_encode (_map + _hdrlen + frame * _bpf, buf, n * _nchan, _fmt);
+		return true;
+	}
+	/* not _raw, this may run concurrently */
+	const size_t len = (size_t)n * _bpf;
+	uint8_t*     raw = (uint8_t*)malloc (len);
+	wav_encode (raw, buf, n * _nchan, _fmt);
+
+	bool          ok  = true;
+	size_t        off = 0;
+	const int64_t pos = _hdrlen + frame * _bpf;
+	while (off < len) {
+		ssize_t rv = pwrite (fileno (_f), raw + off, len - off, pos + off);
+		if (rv <= 0) {
+			ok = false;
+			break;
+		}
+		off += rv;
+	}
+	free (raw);
+	return ok;
+}
+
+bool
+WavWriter::close (void)
+{
+	if (!_f) {
+		return false;
+	}
+
+	if (_map) {
+		munmap (_map, _maplen);
+		_map = 0;
+	}
+
+	if (_headerless) {
+		const bool ok = 0 == fclose (_f);
+		_f            = 0;
+		if (!ok) {
+			_error = "write error";
+		}
+		return ok;
+	}
+
+	const int      fmtlen = fmt_size (_nchan, _fmt);
+	const uint64_t dsize  = _frames * _bpf;
+	const uint64_t rsize  = HDR_SIZE (fmtlen) - 8 + dsize + (dsize & 1);
+
+	if (dsize & 1) {
+		fseeko (_f, _hdrlen + dsize, SEEK_SET);
+		fputc (0, _f);
+	}
+
+	uint8_t hdr[12 + 8 + DS64_SIZE];
+	bool    ok;
+
+	if (rsize <= 0xffffffff) {
+		put32 (hdr, rsize);
+		put32 (hdr + 4, dsize);
+		ok = 0 == fseeko (_f, 4, SEEK_SET) && 1 == fwrite (hdr, 4, 1, _f)
+		     && 0 == fseeko (_f, HDR_SIZE (fmtlen) - 4, SEEK_SET) && 1 == fwrite (hdr + 4, 4, 1, _f);
+	} else {
+		/* EBU Tech 3306 */
+		memset (hdr, 0, sizeof (hdr));
+		memcpy (hdr, "RF64", 4);
+		put32 (hdr + 4, 0xffffffff);
+		memcpy (hdr + 8, "WAVE", 4);
+		memcpy (hdr + 12, "ds64", 4);
+		put32 (hdr + 16, DS64_SIZE);
+		put64 (hdr + 20, rsize);
+		put64 (hdr + 28, dsize);
+		put64 (hdr + 36, _frames);
+
+		uint8_t ff[4] = { 0xff, 0xff, 0xff, 0xff };
+		ok = 0 == fseeko (_f, 0, SEEK_SET) && 1 == fwrite (hdr, sizeof (hdr), 1, _f)
+		     && 0 == fseeko (_f, HDR_SIZE (fmtlen) - 4, SEEK_SET) && 1 == fwrite (ff, 4, 1, _f);
+	}
+
+	if (fclose (_f)) {
+		ok = false;
+	}
+	_f = 0;
+	if (!ok) {
+		_error = "write error";
+	}
+	return ok;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WAVFILE_H
+#define _WAVFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace DPLLV2
+{
+/* sample formats of the data chunk */
+enum WavFormat {
+	WAV_INVALID = 0,
+	WAV_PCM16,
+	WAV_PCM24,
+	WAV_PCM32,
+	WAV_FLOAT32,
+	WAV_FLOAT64,
+};
+
+extern int         wav_format_bytes (int fmt);
+extern const char* wav_format_name (int fmt);
+
+/* convert n samples from/to little-endian fmt. Integer formats are clipped. */
+extern void wav_decode (float* dst, const uint8_t* src, int n, int fmt);
+extern void wav_encode (uint8_t* dst, const float* src, int n, int fmt);
+
+/* Read RIFF/WAVE and RF64 files: 16, 24, 32 bit PCM and
+ * 32, 64 bit float, plain or WAVE_FORMAT_EXTENSIBLE.
+ *
+ * The file is memory-mapped if possible, read() then decodes directly
+ * from the mapping, and float data can be accessed without any copy.
+ */
+class WavReader
+{
+public:
+	WavReader (void);
+	~WavReader (void);
+
+	bool open (const char* path);
+	/* headerless, little-endian */
+	bool open_raw (const char* path, int rate, int nchan, int fmt = WAV_FLOAT32);
+	void close (void);
+
+	/* use buffered stdio instead of mmap, call before open () */
+	void
+	set_mmap (bool yn)
+	{
+		_use_map = yn;
+	}
+
+	/* read up to n frames, interleaved, returns the number of frames read */
+	int read (float* buf, int n);
+
+	/* set the read position, in frames */
+	bool seek (int64_t frame);
+
+	/* interleaved 32 bit float data starting at the given frame,
+	 * inside the mapping. NULL if the file is not mapped, or the
+	 * data needs to be converted: use read () in that case.
+	 */
+	const float* map (int64_t frame) const;
+
+	int
+	channels () const
+	{
+		return _nchan;
+	}
+
+	int
+	rate () const
+	{
+		return _rate;
+	}
+
+	int
+	format () const
+	{
+		return _fmt;
+	}
+
+	int64_t
+	frames () const
+	{
+		return _frames;
+	}
+
+	const char*
+	error () const
+	{
+		return _error;
+	}
+
+private:
+	bool fail (const char* msg);
+	bool finish (int64_t dsize);
+
+	FILE*       _f;
+	int         _nchan;
+	int         _rate;
+	int         _fmt;
+	int         _bpf; // bytes per frame
+	int64_t     _frames;
+	int64_t     _pos;
+	int64_t     _data; // file offset of the first sample
+	uint8_t*    _raw;
+	int         _rawlen;
+	bool        _use_map;
+	uint8_t*    _map; // complete file, or NULL
+	size_t      _maplen;
+	const char* _error;
+};
+
+/* Write RIFF/WAVE, switching to RF64 when the file exceeds 4 GiB.
+ * A JUNK chunk of the size of the RF64 "ds64" chunk is reserved
+ * after the "RIFF" header, and replaced if needed on close().
+ *
+ * Once the length is set, the file is memory-mapped if possible.
+ */
+class WavWriter
+{
+public:
+	WavWriter (void);
+	~WavWriter (void);
+
+	bool open (const char* path, int rate, int nchan, int fmt);
+	/* headerless, little-endian */
+	bool open_raw (const char* path, int nchan, int fmt = WAV_FLOAT32);
+	/* update the header and close the file */
+	bool close (void);
+
+	/* write n frames, interleaved. Integer formats are clipped. */
+	bool write (const float* buf, int n);
+
+	/* Random access: set the length of the file, then write frames
+	 * at any position. write_at() may be called concurrently from
+	 * different threads.
+	 */
+	bool set_length (int64_t frames);
+	bool write_at (int64_t frame, const float* buf, int n);
+
+	/* use pwrite () instead of mmap, call before set_length () */
+	void
+	set_mmap (bool yn)
+	{
+		_use_map = yn;
+	}
+
+	/* interleaved 32 bit float data at the given frame, inside the
+	 * mapping, to be written directly instead of using write_at ().
+	 * NULL if the file is not mapped or the format needs conversion.
+	 */
+	float* map (int64_t frame) const;
+
+	int64_t
+	frames () const
+	{
+		return _frames;
+	}
+
+	const char*
+	error () const
+	{
+		return _error;
+	}
+
+private:
+	bool fail (const char* msg);
+
+	FILE*       _f;
+	int         _nchan;
+	int         _fmt;
+	int         _bpf;
+	int         _hdrlen;
+	bool        _headerless;
+	int64_t     _frames;
+	uint8_t*    _raw;
+	int         _rawlen;
+	bool        _use_map;
+	uint8_t*    _map;
+	size_t      _maplen;
+	const char* _error;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,1027 @@
+/* dpl-check -- compare Peaklim against the frozen reference
+ *
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "peaklim.h"
+#include "refpeaklim.h"
+
+using namespace DPLLV2;
+using namespace DPLREF;
+
+#define NELEM(A) (sizeof (A) / sizeof (A[0]))
+
+/* the three chunk sizes (_div1 8, 16, 32) */
+static const int rates[] = { 44100, 96000, 192000 };
+
+/* 3: the generic (any channel-count) specialization */
+static const int channels[] = { 1, 2, 3, 8 };
+
+/* Frames per call. Odd sizes split chunks (_c1) at every possible
+ * position. 0: random 1..4096, -1: two-pass envelope () in blocks
+ * of 1024.
+ */
+static const int blocksizes[] = { 1, 5, 7, 13, 31, 33, 64, 1001, 0, -1 };
+
+static const float lookaheads[] = { 0.25f, 1.2f, 10.f };
+
+enum TruePeakMode {
+	TP_OFF = 0,
+	TP_LAZY, // the default
+	TP_FULL, // set_truepeak_lazy (false)
+	TP_LAST
+};
+
+static const char* tp_names[] = { "off", "lazy", "full" };
+
+enum Signal {
+	SIG_NOISE = 0, // white noise, +12 dB
+	SIG_MUSIC,     // chords, bass, drum hits and some noise, +10 dB
+	SIG_ISP,       // fs/4 sine at 45 deg: inter-sample peaks 3dB above the samples
+	SIG_SQUARE,    // 100 Hz square, overshoot of the interpolation
+	SIG_BURST,     // silence, loud noise burst, decaying tone: attack and release
+	SIG_LAST
+};
+
+static const char* signal_names[] = { "noise", "music", "isp", "square", "burst" };
+
+static const float signal_gain[] = { 12, 10, 6, 3, 0 };
+
+struct Result {
+	double maxdiff;  // absolute, either output
+	double kdiff;    // absolute, to the scalar kernel
+	double peak;     // worst output sample-peak, relative to the threshold
+	double refpeak;  // same, reference
+	bool   latency;  // equal latency
+	char   worst[128];
+	int    cases;
+};
+
+static uint32_t
+rnd (uint32_t* s)
+{
+	*s = *s * 1664525 + 1013904223;
+	return *s >> 8;
+}
+
+static float
+rndf (uint32_t* s)
+{
+	return rnd (s) / 8388608.f - 1.f;
+}
+
+static void
+generate (float* x, int n, int c, int rate, int sig, uint32_t seed)
+{
+	uint32_t s = seed * 31 + c;
+	float    z = 0;
+	for (int i = 0; i < n; ++i) {
+		const double t = (double)i / rate;
+		switch (sig) {
+			case SIG_NOISE:
+				x[i] = 0.5f * rndf (&s);
+				break;
+			case SIG_MUSIC: {
+				/* a chord per second, bass, a kick every 0.5 sec, hi-hat noise */
+				const double ch  = floor (t);
+				const double f0  = 110 * pow (2, fmod (ch * 5, 12) / 12) * (1 + 0.002 * c);
+				const double env = exp (-2 * fmod (t, 1.0));
+				const double kt  = fmod (t, 0.5);
+				double       v   = 0;
+				v += 0.3 * env * sin (2 * M_PI * 2 * f0 * t);
+				v += 0.2 * env * sin (2 * M_PI * 2.52 * f0 * t);
+				v += 0.2 * env * sin (2 * M_PI * 3 * f0 * t + c);
+				v += 0.3 * sin (2 * M_PI * f0 / 2 * t);
+				v += 0.8 * exp (-30 * kt) * sin (2 * M_PI * (50 + 150 * exp (-40 * kt)) * kt);
+				z += 0.3f * (rndf (&s) - z);
+				v += 0.05 * z;
+				x[i] = v;
+			} break;
+			case SIG_ISP:
+				x[i] = 0.7f * sin (M_PI / 2 * i + M_PI / 4 + 0.1 * c);
+				break;
+			case SIG_SQUARE:
+				x[i] = fmod (t * 100 + 0.1 * c, 1.0) < 0.5 ? 0.9f : -0.9f;
+				break;
+			case SIG_BURST: {
+				const double p = fmod (t, 0.4);
+				if (p < 0.1) {
+					x[i] = 0;
+				} else if (p < 0.15) {
+					x[i] = rndf (&s);
+				} else {
+					x[i] = 0.5 * exp (-10 * (p - 0.15)) * sin (2 * M_PI * 441 * t);
+				}
+			} break;
+		}
+	}
+}
+
+struct Buffers {
+	float** inp;
+	float** out;
+	float** ip;
+	float** op;
+	int     nchan;
+	int     n;
+
+	Buffers (int nc, int len, int pre)
+	    : nchan (nc)
+	    , n (len)
+	{
+		inp = new float*[nchan];
+		out = new float*[nchan];
+		ip  = new float*[nchan];
+		op  = new float*[nchan];
+		for (int c = 0; c < nchan; ++c) {
+			inp[c] = new float[pre + n] + pre;
+			out[c] = new float[n];
+			memset (inp[c] - pre, 0, (pre + n) * sizeof (float));
+		}
+		_pre = pre;
+	}
+
+	~Buffers ()
+	{
+		for (int c = 0; c < nchan; ++c) {
+			delete[] (inp[c] - _pre);
+			delete[] out[c];
+		}
+		delete[] inp;
+		delete[] out;
+		delete[] ip;
+		delete[] op;
+	}
+
+	void
+	offset (int k)
+	{
+		for (int c = 0; c < nchan; ++c) {
+			ip[c] = inp[c] + k;
+			op[c] = out[c] + k;
+		}
+	}
+
+private:
+	int _pre;
+};
+
+/* parameters are set at the start, the input-gain changes at `mid` */
+static void
+setup (Peaklim* p, int sig)
+{
+	p->set_inpgain (signal_gain[sig]);
+	p->set_threshold (-1);
+	p->set_release (0.01);
+}
+
+static void
+setup (RefPeaklim* p, int sig)
+{
+	p->set_inpgain (signal_gain[sig]);
+	p->set_threshold (-1);
+	p->set_release (0.01);
+}
+
+static int
+next_block (int bs, int k, int n, int mid, uint32_t* seed)
+{
+	int ns = bs > 0 ? bs : bs == 0 ? 1 + rnd (seed) % 4096 : 1024;
+	if (k < mid && k + ns > mid) {
+		ns = mid - k;
+	}
+	return ns < n - k ? ns : n - k;
+}
+
+/* The limiter's output depends on the how the input is split
+ * into blocks (a chunk's gain-reduction applies from the start of
+ * the block in which the chunk completes), the reference is run
+ * with the same blocks.
+ * Returns the latency.
+ */
+static int
+run_ref (Buffers* b, int rate, float la, int tp, int sig, int bs, uint32_t seed)
+{
+	RefPeaklim p;
+	p.init (rate, b->nchan, la, tp != TP_OFF);
+	setup (&p, sig);
+	p.set_truepeak (tp != TP_OFF);
+
+	const int mid = b->n / 2;
+	for (int k = 0; k < b->n;) {
+		const int ns = next_block (bs, k, b->n, mid, &seed);
+		if (k == mid) {
+			p.set_inpgain (signal_gain[sig] - 6);
+		}
+		b->offset (k);
+		p.process (ns, b->ip, b->op);
+		k += ns;
+	}
+	return p.get_latency ();
+}
+
+/* returns the latency */
+static int
+run_dut (Buffers* b, int rate, float la, int tp, int sig, int isa, int bs, uint32_t seed)
+{
+	Peaklim p;
+	p.init (rate, b->nchan, isa);
+	p.set_lookahead (la);
+	setup (&p, sig);
+	p.set_truepeak (tp != TP_OFF);
+	p.set_truepeak_lazy (tp != TP_FULL);
+
+	const int mid = b->n / 2;
+
+	if (bs >= 0) {
+		for (int k = 0; k < b->n;) {
+			const int ns = next_block (bs, k, b->n, mid, &seed);
+			if (k == mid) {
+				p.set_inpgain (signal_gain[sig] - 6);
+			}
+			b->offset (k);
+			p.process (ns, b->ip, b->op);
+			k += ns;
+		}
+		return p.get_latency ();
+	}
+
+	/* two-pass: the gain is computed for the input in place,
+	 * then applied with the delay
+	 */
+	const int delay = p.get_latency ();
+	float*    gain  = new float[b->n];
+	for (int k = 0; k < b->n;) {
+		const int ns = next_block (bs, k, b->n, mid, &seed);
+		if (k == mid) {
+			p.set_inpgain (signal_gain[sig] - 6);
+		}
+		b->offset (k);
+		p.envelope (ns, b->ip, gain + k);
+		k += ns;
+	}
+	for (int c = 0; c < b->nchan; ++c) {
+		for (int i = 0; i < b->n; ++i) {
+			b->out[c][i] = i < delay ? 0 : b->inp[c][i - delay] * gain[i];
+		}
+	}
+	delete[] gain;
+	return delay;
+}
+
+static double
+peak (const Buffers* b)
+{
+	double pk = 0;
+	for (int c = 0; c < b->nchan; ++c) {
+		for (int i = 0; i < b->n; ++i) {
+			pk = fmax (pk, fabsf (b->out[c][i]));
+		}
+	}
+	return pk;
+}
+
+static double
+true_peak (const Buffers* b)
+{
+	double pk = 0;
+	for (int c = 0; c < b->nchan; ++c) {
+		pk = fmax (pk, RefPeaklim::true_peak (b->out[c], b->n));
+	}
+	return pk;
+}
+
+static double
+to_db (double v)
+{
+	return v > 0 ? 20 * log10 (v) : -999;
+}
+
+/* "exact" for identical output */
+static const char*
+db_str (char* buf, double v)
+{
+	if (v > 0) {
+		sprintf (buf, "%.2f", to_db (v));
+	} else {
+		strcpy (buf, "exact");
+	}
+	return buf;
+}
+
+/* Histmin (monotonic deque) against the original rescanning one:
+ * random values with ties, random window lengths and resets.
+ * Returns the number of steps where vmin () differs.
+ */
+static int
+check_histmin (uint32_t seed, int* steps)
+{
+	const int nrun  = 64;
+	const int nstep = 20000;
+	int       fail  = 0;
+
+	*steps = 0;
+	for (int r = 0; r < nrun; ++r) {
+		DPLLV2::Histmin hnew;
+		DPLREF::Histmin href;
+
+		const int hlen = 1 + rnd (&seed) % DPLREF::Histmin::SIZE;
+		hnew.init (hlen, DPLREF::Histmin::SIZE);
+		href.init (hlen);
+
+		for (int i = 0; i < nstep; ++i) {
+			const uint32_t op = rnd (&seed) % 1024;
+			if (op < 16) {
+				const int len = 1 + rnd (&seed) % DPLREF::Histmin::SIZE;
+				hnew.set_length (len);
+				href.set_length (len);
+			} else if (op == 16) {
+				hnew.reset ();
+				href.reset ();
+			}
+			/* 0 .. 1.5 in steps of 1/16: ties, and values above the initial 1 */
+			const float v = (rnd (&seed) % 25) / 16.f;
+			hnew.write (v);
+			href.write (v);
+			if (hnew.vmin () != href.vmin ()) {
+				++fail;
+			}
+			++*steps;
+		}
+	}
+	return fail;
+}
+
+/* Bypass: set_bypass () is toggled at random block boundaries, every
+ * 1..30 ms, so that all states (filling either delay-line, crossfade)
+ * are reached and reversed. The input peaks 12 dB below the threshold
+ * (inter-sample peaks of noise are some dB above the samples):
+ *  - quiet (no input-gain): the output has to be exactly the delayed
+ *    input, whatever the state.
+ *  - loud (+20 dB input-gain): the limiter and the dry input are both
+ *    below the threshold, and so has to be the crossfade.
+ * Also the latency must not change. Returns the maximum difference of
+ * the quiet case and the peak relative to the threshold of the loud
+ * one; latency is set to false if it changed.
+ */
+static void
+check_bypass (int rate, int nchan, int isa, int tp, int bs, bool inplace, int sig, uint32_t seed,
+              double* diff, double* peak, bool* latency, int* toggles)
+{
+	const int   n      = 1.0 * rate;
+	const float thresh = pow (10, -1 / 20.);
+
+	Buffers b (nchan, n, Upsampler::NTAPS - 1);
+	for (int c = 0; c < nchan; ++c) {
+		generate (b.inp[c], n, c, rate, sig, seed);
+	}
+	double pk = 0;
+	for (int c = 0; c < nchan; ++c) {
+		for (int i = 0; i < n; ++i) {
+			pk = fmax (pk, fabsf (b.inp[c][i]));
+		}
+	}
+	for (int c = 0; c < nchan; ++c) {
+		for (int i = 0; i < n; ++i) {
+			b.inp[c][i] *= 0.25 * thresh / pk;
+		}
+	}
+
+	*diff    = 0;
+	*peak    = 0;
+	*latency = true;
+	*toggles = 0;
+
+	for (int loud = 0; loud < 2; ++loud) {
+		Peaklim p;
+		p.init (rate, nchan, isa);
+		p.set_inpgain (loud ? 20 : 0);
+		p.set_threshold (-1);
+		p.set_release (0.01);
+		p.set_truepeak (tp != TP_OFF);
+		p.set_truepeak_lazy (tp != TP_FULL);
+
+		const int delay = p.get_latency ();
+
+		uint32_t s      = seed;
+		bool     bypass = false;
+		int      next   = 0;
+		for (int k = 0; k < n;) {
+			int ns = bs > 0 ? bs : 1 + 2 * (rnd (&s) % 128);
+			ns     = ns < n - k ? ns : n - k;
+			if (k >= next) {
+				bypass = !bypass;
+				p.set_bypass (bypass);
+				next = k + 1 + rnd (&s) % (rate * 3 / 100);
+				++*toggles;
+			}
+			b.offset (k);
+			if (inplace) {
+				for (int c = 0; c < nchan; ++c) {
+					memcpy (b.op[c], b.ip[c], ns * sizeof (float));
+				}
+				p.process (ns, b.op, b.op);
+			} else {
+				p.process (ns, b.ip, b.op);
+			}
+			*latency = *latency && p.get_latency () == delay;
+			k += ns;
+		}
+
+		for (int c = 0; c < nchan; ++c) {
+			for (int i = 0; i < n; ++i) {
+				if (loud) {
+					*peak = fmax (*peak, fabsf (b.out[c][i]) / thresh);
+				} else {
+					const float x = i < delay ? 0.f : b.inp[c][i - delay];
+					*diff         = fmax (*diff, fabs ((double)b.out[c][i] - x));
+				}
+			}
+		}
+	}
+}
+
+/* Latency against the reference, for more sample-rates than the other
+ * tests: the default, set_lookahead () before and after set_truepeak ().
+ * Returns the number of differences.
+ */
+static int
+check_latency (int* cases)
+{
+	static const int   lrates[] = { 22050, 32000, 40000, 44100, 48000, 80000, 88200, 96000, 160000, 176400, 192000 };
+	static const float lla[]    = { 0.25f, 0.5f, 1.2f, 2.5f, 5.f, 10.f };
+
+	int fail = 0;
+	*cases   = 0;
+	for (size_t ri = 0; ri < NELEM (lrates); ++ri) {
+		for (int tp = 0; tp < 2; ++tp) {
+			RefPeaklim r;
+			Peaklim    p;
+			r.init (lrates[ri], 1, 1.2f, tp);
+			p.init (lrates[ri], 1, KERNEL_SCALAR);
+			p.set_truepeak (tp);
+			fail += p.get_latency () != r.get_latency ();
+			++*cases;
+
+			for (size_t li = 0; li < NELEM (lla); ++li) {
+				r.init (lrates[ri], 1, lla[li], tp);
+				p.set_truepeak (!tp);
+				p.set_lookahead (lla[li]);
+				p.set_truepeak (tp);
+				fail += p.get_latency () != r.get_latency ();
+				p.set_lookahead (lla[li]);
+				fail += p.get_latency () != r.get_latency ();
+				*cases += 2;
+			}
+		}
+	}
+	return fail;
+}
+
+/* PeaklimBatch against one Peaklim per lane (scalar kernels, true-peak
+ * off), each lane with a different signal, gain, threshold and release.
+ * Half-way the gain changes, and on some lanes the threshold and/or
+ * release (which then ramp).
+ * Returns the maximum absolute difference.
+ */
+static double
+check_batch (int rate, int nchan, int lanes, float la, int isa, int bs, int n, uint32_t seed)
+{
+	Buffers* ref[PeaklimBatch::MAXLANES];
+	Buffers* dut[PeaklimBatch::MAXLANES];
+	float**  ip[PeaklimBatch::MAXLANES];
+	float**  op[PeaklimBatch::MAXLANES];
+
+	PeaklimBatch pb;
+	pb.init (rate, nchan, lanes, la, isa);
+
+	for (int l = 0; l < lanes; ++l) {
+		const int sig = l % SIG_LAST;
+		ref[l]        = new Buffers (nchan, n, 0);
+		dut[l]        = new Buffers (nchan, n, 0);
+		for (int j = 0; j < nchan; ++j) {
+			generate (ref[l]->inp[j], n, j, rate, sig, seed + l);
+			memcpy (dut[l]->inp[j], ref[l]->inp[j], n * sizeof (float));
+		}
+		pb.set_inpgain (l, signal_gain[sig]);
+		pb.set_threshold (l, -1.f - (l % 4));
+		pb.set_release (l, 0.002f * (1 + l));
+		ip[l] = dut[l]->ip;
+		op[l] = dut[l]->op;
+	}
+
+	const int mid = n / 2;
+	uint32_t  bseed = seed;
+	for (int k = 0; k < n;) {
+		const int ns = next_block (bs, k, n, mid, &bseed);
+		if (k == mid) {
+			for (int l = 0; l < lanes; ++l) {
+				pb.set_inpgain (l, signal_gain[l % SIG_LAST] - 6);
+				if (l % 2 == 0) {
+					pb.set_threshold (l, -4.f - (l % 3));
+				}
+				if (l % 3 == 0) {
+					pb.set_release (l, 0.05f * (1 + l));
+				}
+			}
+		}
+		for (int l = 0; l < lanes; ++l) {
+			dut[l]->offset (k);
+		}
+		pb.process_batch (ns, ip, op);
+		k += ns;
+	}
+
+	double d = 0;
+	for (int l = 0; l < lanes; ++l) {
+		const int sig = l % SIG_LAST;
+		Peaklim   p;
+		p.init (rate, nchan, KERNEL_SCALAR);
+		p.set_lookahead (la);
+		p.set_inpgain (signal_gain[sig]);
+		p.set_threshold (-1.f - (l % 4));
+		p.set_release (0.002f * (1 + l));
+		p.set_truepeak (false);
+
+		bseed = seed;
+		for (int k = 0; k < n;) {
+			const int ns = next_block (bs, k, n, mid, &bseed);
+			if (k == mid) {
+				p.set_inpgain (signal_gain[sig] - 6);
+				if (l % 2 == 0) {
+					p.set_threshold (-4.f - (l % 3));
+				}
+				if (l % 3 == 0) {
+					p.set_release (0.05f * (1 + l));
+				}
+			}
+			ref[l]->offset (k);
+			p.process (ns, ref[l]->ip, ref[l]->op);
+			k += ns;
+		}
+
+		for (int j = 0; j < nchan; ++j) {
+			for (int i = 0; i < n; ++i) {
+				d = fmax (d, fabs ((double)dut[l]->out[j][i] - ref[l]->out[j][i]));
+			}
+		}
+		delete ref[l];
+		delete dut[l];
+	}
+	return d;
+}
+
+/* gain [dB] at output sample i (i >= latency) for a constant input */
+static double
+gain_db (const Buffers* b, int i, float dc)
+{
+	return to_db (b->out[0][i] / dc);
+}
+
+/* Threshold and release ramps. The input is constant (DC), the
+ * output is then the gain (times the input) and it is known where it
+ * settles: threshold / input.
+ *  - the threshold falls from -1 to -7 dB: half-way through RAMPTIME
+ *    the gain has to be half-way (in dB), after RAMPTIME (and the
+ *    attack) at the target.
+ *  - the threshold rises to -1 dB with 1 sec release, then the release
+ *    is set to 1 ms: after a tenth of RAMPTIME the gain may only have
+ *    risen slightly (an immediate change would cover 63% of the
+ *    distance), after RAMPTIME it has to be at the target.
+ * Returns the deviation from the threshold half-way point [dB] and
+ * the release rise [fraction], pass is set to false on failure.
+ */
+static void
+check_ramp (int rate, int isa, double* thdev, double* rlrise, bool* pass)
+{
+	const int   nchan = 2;
+	const float dc    = 0.9f;
+	const int   n     = 0.6 * rate;
+	const int   t1    = 0.2 * rate; // threshold -7
+	const int   t2    = 0.3 * rate; // release 1 sec
+	const int   t3    = 0.4 * rate; // threshold -1
+	const int   t4    = 0.5 * rate; // release 1 msec
+	const int   ramp  = Peaklim::RAMPTIME * rate;
+
+	Buffers b (nchan, n, 0);
+	for (int c = 0; c < nchan; ++c) {
+		for (int i = 0; i < n; ++i) {
+			b.inp[c][i] = dc;
+		}
+	}
+
+	Peaklim p;
+	p.init (rate, nchan, isa);
+	p.set_inpgain (0);
+	p.set_threshold (-1);
+	p.set_release (0.01);
+	p.set_truepeak (false);
+
+	const int delay = p.get_latency ();
+
+	for (int k = 0; k < n;) {
+		int ns = 64;
+		if (k == t1) {
+			p.set_threshold (-7);
+		} else if (k == t2) {
+			p.set_release (1.0);
+		} else if (k == t3) {
+			p.set_threshold (-1);
+		} else if (k == t4) {
+			p.set_release (0.001);
+		}
+		const int ev[] = { t1, t2, t3, t4, n };
+		for (size_t e = 0; e < NELEM (ev); ++e) {
+			if (k < ev[e] && k + ns > ev[e]) {
+				ns = ev[e] - k;
+			}
+		}
+		b.offset (k);
+		p.process (ns, b.ip, b.op);
+		k += ns;
+	}
+
+	const double in_db  = to_db (dc);
+	const double g_hi   = -1 - in_db;
+	const double g_lo   = -7 - in_db;
+	const double settle = 0.005 * rate;
+
+	bool ok = true;
+	ok      = ok && fabs (gain_db (&b, t1 - 1, dc) - g_hi) < 0.01;
+	ok      = ok && fabs (gain_db (&b, t1 + ramp + delay + settle, dc) - g_lo) < 0.01;
+
+	*thdev = gain_db (&b, t1 + ramp / 2, dc) - .5 * (g_hi + g_lo);
+	ok     = ok && fabs (*thdev) < 0.5;
+
+	/* still rising slowly, 1 sec release */
+	const double g4 = gain_db (&b, t4, dc);
+	ok              = ok && g4 < g_hi - 1;
+
+	*rlrise = (gain_db (&b, t4 + ramp / 10, dc) - g4) / (g_hi - g4);
+	ok      = ok && *rlrise < 0.1;
+	ok      = ok && fabs (gain_db (&b, t4 + ramp + 4 * settle, dc) - g_hi) < 0.01;
+
+	/* the output never exceeds the threshold */
+	for (int i = 0; i < n; ++i) {
+		ok = ok && gain_db (&b, i, dc) < g_hi + 0.01;
+	}
+
+	*pass = ok;
+}
+
+static void
+usage (int status)
+{
+	printf ("dpl-check - Compare the limiter to the frozen reference implementation.\n\n");
+	printf ("Usage: dpl-check [ OPTIONS ]\n\n");
+	printf ("Options:\n"
+	        " -d, --duration <sec>     length of each test signal (default: 0.5)\n"
+	        " -D, --max-diff <dB>      maximum difference to the reference,\n"
+	        "                          relative to full-scale (default: -60)\n"
+	        " -K, --max-kernel-diff <dB>\n"
+	        "                          maximum difference of the SIMD kernels to\n"
+	        "                          the scalar one (default: -100)\n"
+	        " -P, --max-peak <dB>      maximum output peak above the threshold\n"
+	        "                          (default: 0.02)\n"
+	        " -T, --max-truepeak <dB>  maximum output true-peak above the threshold,\n"
+	        "                          with true-peak enabled (default: 0.2)\n"
+	        " -s, --seed <num>         random seed (default: 1)\n"
+	        " -v, --verbose            print every test case\n"
+	        " -h, --help               display this help and exit\n"
+	        "\n");
+	printf ("The sliding-window minimum (Histmin) is first compared to the original\n"
+	        "rescanning implementation, with random values and window lengths, and\n"
+	        "the latency to the reference's for all common sample-rates.\n\n");
+	printf ("Then threshold and release ramps are checked with a constant input:\n"
+	        "reported is the gain half-way through a threshold ramp relative to the\n"
+	        "half-way point [dB] (limit 0.5), and how far the gain rose in the first\n"
+	        "tenth of a release ramp [%%] (limit 10).\n\n");
+	printf ("Bypass is toggled every 1..30 ms at block boundaries, in place and\n"
+	        "not, with an input 12 dB below the threshold. Without input-gain the\n"
+	        "output has to be exactly the delayed input (diff), with +20 dB the peak\n"
+	        "may not exceed the threshold (limit -P) also during the crossfades, and\n"
+	        "the latency must be constant.\n\n");
+	printf ("Last, the batch engine (PeaklimBatch) is compared to Peaklim with the\n"
+	        "scalar kernel, for 4, 8 and 16 lanes, with threshold and release changes\n"
+	        "half-way; the limit is that to the scalar kernel.\n\n");
+	printf ("Every DSP kernel supported by the CPU is tested, for all chunk sizes\n"
+	        "(sample-rates), specialized and generic channel-counts, true-peak modes,\n"
+	        "look-ahead times and block sizes (including two-pass), with a gain change\n"
+	        "half-way. Reported are the maximum absolute difference to the reference\n"
+	        "and to the scalar kernel, the worst output peak relative to the threshold,\n"
+	        "the same for the reference, and whether the latency is the same. Last the\n"
+	        "worst true-peak of the output with true-peak enabled (64 frame blocks).\n"
+	        "The exit status is non-zero if any of those exceed the limits.\n\n");
+	printf ("The reference accumulates the input-gain ramp sample by sample, which\n"
+	        "limits the agreement to about -70 dB during gain changes at 192kHz.\n"
+	        "It also exceeds the threshold by up to 0.012 dB: the attack reaches its\n"
+	        "target only within exp (-10).\n");
+	exit (status);
+}
+
+static struct option const long_options[] = {
+	{ "duration", required_argument, 0, 'd' },
+	{ "max-diff", required_argument, 0, 'D' },
+	{ "max-kernel-diff", required_argument, 0, 'K' },
+	{ "max-peak", required_argument, 0, 'P' },
+	{ "max-truepeak", required_argument, 0, 'T' },
+	{ "seed", required_argument, 0, 's' },
+	{ "verbose", no_argument, 0, 'v' },
+	{ "help", no_argument, 0, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+int
+main (int argc, char** argv)
+{
+	double   dur     = 0.5;
+	double   maxdiff  = -60;
+	double   maxkdiff = -100;
+	double   maxpeak  = 0.02;
+	double   maxtp    = 0.2;
+	uint32_t seed     = 1;
+	bool     verbose  = false;
+
+	int c;
+	while ((c = getopt_long (argc, argv,
+	                         "d:" /* duration */
+	                         "D:" /* max-diff */
+	                         "K:" /* max-kernel-diff */
+	                         "P:" /* max-peak */
+	                         "T:" /* max-truepeak */
+	                         "s:" /* seed */
+	                         "v"  /* verbose */
+	                         "h", /* help */
+	                         long_options, (int*)0)) != EOF) {
+		switch (c) {
+			case 'd':
+				dur = atof (optarg);
+				break;
+			case 'D':
+				maxdiff = atof (optarg);
+				break;
+			case 'K':
+				maxkdiff = atof (optarg);
+				break;
+			case 'P':
+				maxpeak = atof (optarg);
+				break;
+			case 'T':
+				maxtp = atof (optarg);
+				break;
+			case 's':
+				seed = atoi (optarg);
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			case 'h':
+				usage (EXIT_SUCCESS);
+				break;
+			default:
+				usage (EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if (dur <= 0 || optind != argc) {
+		usage (EXIT_FAILURE);
+	}
+
+	const double thresh = pow (10, -1 / 20.);
+	bool         ok     = true;
+	double       tpmax  = 0;
+	char         tpworst[160] = "";
+
+	const DSPKernels* kern[KERNEL_AVX512 + 1];
+	for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+		if (!(kern[isa] = dsp_kernels (isa))) {
+			static const char* kn[] = { "", "scalar", "sse2", "avx2", "avx512" };
+			printf ("%s is not supported by this CPU, skipped\n", kn[isa]);
+		}
+	}
+
+	int       hsteps;
+	const int hfail = check_histmin (seed, &hsteps);
+	printf ("histmin: %d steps, %d differ%s\n", hsteps, hfail, hfail ? "  FAIL" : "");
+	ok = ok && hfail == 0;
+
+	int       lcases;
+	const int lfail = check_latency (&lcases);
+	printf ("latency: %d cases, %d differ%s\n", lcases, lfail, lfail ? "  FAIL" : "");
+	ok = ok && lfail == 0;
+
+	printf ("%-7s %6s %4s %5s %9s %11s %9s %9s %7s  %s\n",
+	        "kernel", "rate", "tp", "cases", "diff[dB]", "scalar[dB]", "peak[dB]", "ref[dB]", "latency", "worst difference");
+
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (int tp = 0; tp < TP_LAST; ++tp) {
+			Result res[KERNEL_AVX512 + 1];
+			memset (res, 0, sizeof (res));
+
+			for (size_t ci = 0; ci < NELEM (channels); ++ci) {
+				for (int sig = 0; sig < SIG_LAST; ++sig) {
+					const int   rate  = rates[ri];
+					const int   nchan = channels[ci];
+					const int   n     = dur * rate;
+					const float la    = lookaheads[(ri + ci + sig) % NELEM (lookaheads)];
+
+					for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+						const int bs = blocksizes[bi];
+
+						Buffers ref (nchan, n, 0);
+						for (int j = 0; j < nchan; ++j) {
+							generate (ref.inp[j], n, j, rate, sig, seed);
+						}
+						const int    ref_latency = run_ref (&ref, rate, la, tp, sig, bs, seed + bi);
+						const double ref_peak    = peak (&ref) / thresh;
+
+						char blk[32];
+						if (bs > 0) {
+							snprintf (blk, sizeof (blk), "%d frames", bs);
+						} else {
+							strcpy (blk, bs == 0 ? "random blocks" : "two-pass");
+						}
+						char desc[128];
+						snprintf (desc, sizeof (desc), "%dch %s, %.2fms, %s", nchan, signal_names[sig], la, blk);
+
+						Buffers scalar (nchan, n, 0);
+
+						for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+							if (!kern[isa]) {
+								continue;
+							}
+							Buffers dut (nchan, n, Upsampler::NTAPS - 1);
+							for (int j = 0; j < nchan; ++j) {
+								memcpy (dut.inp[j], ref.inp[j], n * sizeof (float));
+							}
+							const int latency = run_dut (&dut, rate, la, tp, sig, isa, bs, seed + bi);
+
+							double d  = 0;
+							double kd = 0;
+							for (int j = 0; j < nchan; ++j) {
+								if (isa == KERNEL_SCALAR) {
+									memcpy (scalar.out[j], dut.out[j], n * sizeof (float));
+								}
+								for (int i = 0; i < n; ++i) {
+									d  = fmax (d, fabs ((double)dut.out[j][i] - ref.out[j][i]));
+									kd = fmax (kd, fabs ((double)dut.out[j][i] - scalar.out[j][i]));
+								}
+							}
+							const double pk = peak (&dut) / thresh;
+
+							Result* r = &res[isa];
+							if (d > r->maxdiff || r->cases == 0) {
+								r->maxdiff = d;
+								strcpy (r->worst, desc);
+							}
+							r->kdiff   = fmax (r->kdiff, kd);
+							r->peak    = fmax (r->peak, pk);
+							r->refpeak = fmax (r->refpeak, ref_peak);
+							r->latency = (r->cases == 0 || r->latency) && latency == ref_latency;
+							++r->cases;
+
+							if (tp != TP_OFF && bs == 64 && isa == KERNEL_SCALAR) {
+								const double tpk = true_peak (&dut) / thresh;
+								if (tpk > tpmax) {
+									tpmax = tpk;
+									snprintf (tpworst, sizeof (tpworst), "%d Hz, %s", rate, desc);
+								}
+							}
+
+							if (verbose) {
+								char b1[16], b2[16];
+								printf ("  %-7s %6d %4s  diff %8s dB  scalar %8s dB  peak %+8.4f dB  latency %d  %s\n",
+								        kern[isa]->name, rate, tp_names[tp], db_str (b1, d), db_str (b2, kd), to_db (pk), latency, desc);
+							}
+						}
+					}
+				}
+			}
+
+			for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+				if (!kern[isa]) {
+					continue;
+				}
+				const Result* r    = &res[isa];
+				const bool    pass = to_db (r->maxdiff) <= maxdiff && to_db (r->kdiff) <= maxkdiff
+				                && to_db (r->peak) <= maxpeak && r->latency;
+				ok = ok && pass;
+
+				char b1[16], b2[16];
+				printf ("%-7s %6d %4s %5d %9s %11s %+9.4f %+9.4f %7s  %s%s\n",
+				        kern[isa]->name, rates[ri], tp_names[tp], r->cases, db_str (b1, r->maxdiff),
+				        db_str (b2, r->kdiff), to_db (r->peak), to_db (r->refpeak), r->latency ? "equal" : "DIFFER",
+				        r->worst, pass ? "" : "  FAIL");
+			}
+		}
+	}
+
+	printf ("%-7s %6s %13s %11s\n", "ramp", "rate", "threshold[dB]", "release[%]");
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+			if (!kern[isa]) {
+				continue;
+			}
+			double thdev, rlrise;
+			bool   pass;
+			check_ramp (rates[ri], isa, &thdev, &rlrise, &pass);
+			ok = ok && pass;
+
+			printf ("%-7s %6d %+13.3f %11.2f%s\n", kern[isa]->name, rates[ri], thdev, 100 * rlrise, pass ? "" : "  FAIL");
+		}
+	}
+
+	printf ("%-7s %6s %5s %7s %9s %9s %7s\n", "bypass", "rate", "cases", "toggles", "diff[dB]", "peak[dB]", "latency");
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+			if (!kern[isa]) {
+				continue;
+			}
+			int    cases   = 0;
+			int    toggles = 0;
+			double d       = 0;
+			double pk      = 0;
+			bool   lat     = true;
+			for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+				if (blocksizes[bi] < 0) {
+					continue;
+				}
+				for (int inplace = 0; inplace < 2; ++inplace) {
+					const int tp  = (bi + inplace) % TP_LAST;
+					const int sig = (bi % 2) ? SIG_MUSIC : SIG_BURST;
+					const int ch  = channels[(bi + inplace) % NELEM (channels)];
+					double    cd, cp;
+					bool      cl;
+					int       ct;
+					check_bypass (rates[ri], ch, isa, tp, blocksizes[bi], inplace, sig, seed + bi, &cd, &cp, &cl, &ct);
+					d   = fmax (d, cd);
+					pk  = fmax (pk, cp);
+					lat = lat && cl;
+					toggles += ct;
+					++cases;
+				}
+			}
+			const bool pass = d == 0 && to_db (pk) <= maxpeak && lat;
+			ok              = ok && pass;
+
+			char b1[16];
+			printf ("%-7s %6d %5d %7d %9s %+9.4f %7s%s\n", kern[isa]->name, rates[ri], cases, toggles, db_str (b1, d), to_db (pk),
+			        lat ? "const" : "CHANGED", pass ? "" : "  FAIL");
+		}
+	}
+
+	printf ("%-7s %6s %5s %5s %9s\n", "batch", "rate", "lanes", "cases", "diff[dB]");
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		static const int lanes[] = { 4, 8, 16 };
+		for (size_t li = 0; li < NELEM (lanes); ++li) {
+			for (int isa = KERNEL_SCALAR; isa <= KERNEL_AVX512; ++isa) {
+				if (!kern[isa]) {
+					continue;
+				}
+				const int n     = dur * rates[ri];
+				int       cases = 0;
+				double    d     = 0;
+				for (size_t ci = 0; ci < 3; ++ci) {
+					const float la = lookaheads[(ri + ci + li) % NELEM (lookaheads)];
+					for (int bs = 0; bs <= 64; bs += 64, ++cases) {
+						d = fmax (d, check_batch (rates[ri], channels[ci], lanes[li], la, isa, bs, n, seed + ci));
+					}
+				}
+				const bool pass = to_db (d) <= maxkdiff;
+				ok              = ok && pass;
+
+				char b1[16];
+				printf ("%-7s %6d %5d %5d %9s%s\n", kern[isa]->name, rates[ri], lanes[li], cases, db_str (b1, d), pass ? "" : "  FAIL");
+			}
+		}
+	}
+
+	const bool tppass = to_db (tpmax) <= maxtp;
+	ok                = ok && tppass;
+	printf ("output true-peak with true-peak enabled: %+.3f dB above the threshold, %s%s\n", to_db (tpmax), tpworst, tppass ? "" : "  FAIL");
+	printf ("%s (limits: difference %.1f dB, to scalar %.1f dB, peak %+.4f dB, true-peak %+.3f dB above the threshold)\n",
+	        ok ? "PASS" : "FAIL", maxdiff, maxkdiff, maxpeak, maxtp);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2010-2018 Fons Adriaensen <fons@linuxaudio.org>
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REFPEAKLIM_H
+#define _REFPEAKLIM_H
+
+#include <stdint.h>
+
+/* Frozen reference of the limiter, for `make check` only.
+ *
+ * This is the plain sample-by-sample scalar process () as it was
+ * before any optimization, with only the channel-count and look-ahead
+ * generalized. Do not change or optimize it: src/peaklim.cc is
+ * compared against it.
+ */
+namespace DPLREF
+{
+class Histmin
+{
+public:
+	void  init (int hlen);
+	float write (float v);
+	float
+	vmin (void)
+	{
+		return _vmin;
+	}
+
+	/* Only used to check DPLLV2::Histmin, these give the same
+	 * semantics with the rescanning algorithm: values that left
+	 * the window do not come back when it is made longer.
+	 * At most one set_length () call between writes.
+	 */
+	void set_length (int hlen);
+	void reset (void);
+
+	enum { SIZE = 128,
+	       MASK = SIZE - 1 };
+
+private:
+	int   _hlen;
+	int   _hold;
+	int   _wind;
+	float _vmin;
+	float _hist[SIZE];
+};
+
+class RefPeaklim
+{
+public:
+	enum { MAXCHAN = 16 };
+
+	RefPeaklim (void);
+	~RefPeaklim (void);
+
+	/* lookahead in ms, rounded up to whole chunks; the original's
+	 * fixed 1.2ms is computed as it was. truepeak: the minimum
+	 * look-ahead for true-peak applies (enable it with set_truepeak).
+	 */
+	void init (float fsamp, int nchan, float lookahead, bool truepeak);
+	void fini (void);
+
+	void set_inpgain (float);
+	void set_threshold (float);
+	void set_release (float);
+	void set_truepeak (bool);
+
+	int
+	get_latency () const
+	{
+		return _delay;
+	}
+
+	void process (int nsamp, float* inp[], float* out[]);
+
+	/* peak of the 4x upsampled signal, same filter as true-peak */
+	static float true_peak (const float* x, int n);
+
+private:
+	static float upsample (float* r);
+
+	float   _fsamp;
+	int     _nchan;
+	int     _div1;
+	int     _div2;
+	int     _delay;
+	int     _dmask;
+	int     _delri;
+	float*  _dbuff[MAXCHAN];
+	int     _c1, _c2;
+	float   _g0, _g1, _dg;
+	float   _gt, _m1, _m2;
+	float   _w1, _w2, _w3, _wlf;
+	float   _z1, _z2, _z3;
+	float   _zlf[MAXCHAN];
+	float   _z[MAXCHAN][48];
+	float   _peak;
+	Histmin _hist1;
+	Histmin _hist2;
+	bool    _truepeak;
+};
+
+} // namespace
+
+#endif
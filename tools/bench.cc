@@ -0,0 +1,633 @@
+/* dpl-bench -- throughput of Peaklim::process
+ *
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "peaklim.h"
+
+#ifndef VERSION
+#define VERSION "0"
+#endif
+
+using namespace DPLLV2;
+
+/* sample-rates cover all three chunk sizes (_div1 8, 16, 32) */
+static const int rates[]      = { 44100, 48000, 88200, 96000, 176400, 192000 };
+static const int channels[]   = { 1, 2, 8 };
+static const int blocksizes[] = { 1, 16, 64, 256, 1024, 8192 };
+
+/* --lookahead, ms; otherwise only the default 1.2 ms */
+static const float lookaheads[] = { 0.25f, 0.5f, 1.2f, 2.5f, 5.f, 10.f };
+
+/* --lanes, PeaklimBatch */
+static const int lanes[] = { 4, 8, 16 };
+
+#define NELEM(A) (sizeof (A) / sizeof (A[0]))
+
+enum Signal {
+	SIG_SILENCE = 0,
+	SIG_SINE,     // -10 dBFS, below the threshold: no gain reduction
+	SIG_OVERLOAD, // full-scale sine + noise, +20 dB input gain
+	SIG_NOISE,    // white noise at -6 dBFS, +6 dB input gain
+	SIG_LAST
+};
+
+static const char* signal_names[] = { "silence", "sine", "overload", "noise" };
+
+struct Result {
+	int         rate;
+	int         nchan;
+	int         blocksize;
+	bool        truepeak;
+	bool        tplazy;
+	bool        bypass;
+	float       lookahead; // ms
+	int         latency;   // samples
+	int         signal;
+	const char* kernel;
+	double      ns;     // per sample (and channel), mean
+	double      stddev; // of ns over the repetitions
+	double      realtime;
+	uint64_t    tpchunks;  // true-peak chunks (per channel), all passes
+	uint64_t    tpskipped; // of those, not interpolated (lazy)
+};
+
+/* --lanes: `lanes` streams with one PeaklimBatch, or as many Peaklim */
+struct LaneResult {
+	int         rate;
+	int         nchan;
+	int         blocksize;
+	int         lanes;
+	bool        batch;
+	const char* kernel;
+	double      ns;     // per sample (and channel) of one stream, mean
+	double      stddev; // of ns over the repetitions
+	double      streams;
+};
+
+static double
+walltime (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* deterministic, so that runs are comparable */
+static float
+noise (uint32_t* s)
+{
+	*s = *s * 1664525 + 1013904223;
+	return (*s >> 8) / 8388608.f - 1.f;
+}
+
+static void
+generate (float* x, int n, int c, int rate, int sig)
+{
+	uint32_t    seed = 1 + c;
+	const float f    = 997.f * (1 + 0.01f * c);
+	for (int i = 0; i < n; ++i) {
+		const float s = sinf (2.f * M_PI * f * i / rate);
+		switch (sig) {
+			case SIG_SILENCE:
+				x[i] = 0;
+				break;
+			case SIG_SINE:
+				x[i] = 0.316f * s;
+				break;
+			case SIG_OVERLOAD:
+				x[i] = 0.8f * s + 0.2f * noise (&seed);
+				break;
+			case SIG_NOISE:
+				x[i] = 0.5f * noise (&seed);
+				break;
+		}
+	}
+}
+
+static float
+signal_gain (int sig)
+{
+	switch (sig) {
+		case SIG_OVERLOAD:
+			return 20;
+		case SIG_NOISE:
+			return 6;
+		default:
+			return 0;
+	}
+}
+
+/* Process `dur` seconds of the signal, `reps` times, in blocks of
+ * the given size. The input is a precomputed buffer of that length.
+ */
+static void
+bench (Result* r, int isa, double dur, int reps)
+{
+	const int n = dur * r->rate;
+
+	float** inp = new float*[r->nchan];
+	float** out = new float*[r->nchan];
+	float** ip  = new float*[r->nchan];
+	float** op  = new float*[r->nchan];
+	for (int c = 0; c < r->nchan; ++c) {
+		inp[c] = new float[n];
+		out[c] = new float[n];
+		generate (inp[c], n, c, r->rate, r->signal);
+	}
+
+	Peaklim* p = new Peaklim ();
+	p->init (r->rate, r->nchan, isa);
+	p->set_inpgain (signal_gain (r->signal));
+	p->set_threshold (-1);
+	p->set_release (0.01);
+	p->set_truepeak (r->truepeak);
+	p->set_truepeak_lazy (r->tplazy);
+	p->set_bypass (r->bypass);
+	p->set_lookahead (r->lookahead);
+	r->kernel  = p->kernel_name ();
+	r->latency = p->get_latency ();
+
+	double sum  = 0;
+	double sum2 = 0;
+
+	/* the first pass is a warm-up and not counted */
+	for (int k = -1; k < reps; ++k) {
+		const double t0 = walltime ();
+		for (int i = 0; i < n; i += r->blocksize) {
+			const int ns = n - i < r->blocksize ? n - i : r->blocksize;
+			for (int c = 0; c < r->nchan; ++c) {
+				ip[c] = inp[c] + i;
+				op[c] = out[c] + i;
+			}
+			p->process (ns, ip, op);
+		}
+		const double ns = 1e9 * (walltime () - t0) / ((double)n * r->nchan);
+		if (k >= 0) {
+			sum += ns;
+			sum2 += ns * ns;
+		}
+	}
+
+	r->ns       = sum / reps;
+	r->stddev   = reps > 1 ? sqrt (fmax (0, (sum2 - sum * sum / reps) / (reps - 1))) : 0;
+	r->realtime = 1e9 / (r->ns * r->nchan * r->rate);
+	p->get_truepeak_stats (&r->tpchunks, &r->tpskipped);
+
+	delete p;
+	for (int c = 0; c < r->nchan; ++c) {
+		delete[] inp[c];
+		delete[] out[c];
+	}
+	delete[] inp;
+	delete[] out;
+	delete[] ip;
+	delete[] op;
+}
+
+/* Process `dur` seconds of r->lanes streams of the overload signal
+ * (without true-peak, which PeaklimBatch does not support), either
+ * with one PeaklimBatch or looping over separate Peaklim instances.
+ */
+static void
+bench_lanes (LaneResult* r, int isa, double dur, int reps)
+{
+	const int n = dur * r->rate;
+	const int L = r->lanes;
+
+	float*** inp = new float**[L];
+	float*** out = new float**[L];
+	float*** ip  = new float**[L];
+	float*** op  = new float**[L];
+	for (int l = 0; l < L; ++l) {
+		inp[l] = new float*[r->nchan];
+		out[l] = new float*[r->nchan];
+		ip[l]  = new float*[r->nchan];
+		op[l]  = new float*[r->nchan];
+		for (int c = 0; c < r->nchan; ++c) {
+			inp[l][c] = new float[n];
+			out[l][c] = new float[n];
+			generate (inp[l][c], n, c + l * r->nchan, r->rate, SIG_OVERLOAD);
+		}
+	}
+
+	PeaklimBatch* pb = 0;
+	Peaklim*      pl = 0;
+	if (r->batch) {
+		pb = new PeaklimBatch ();
+		pb->init (r->rate, r->nchan, L, 1.2f, isa);
+		for (int l = 0; l < L; ++l) {
+			pb->set_inpgain (l, signal_gain (SIG_OVERLOAD));
+			pb->set_threshold (l, -1);
+			pb->set_release (l, 0.01);
+		}
+		r->kernel = pb->kernel_name ();
+	} else {
+		pl = new Peaklim[L];
+		for (int l = 0; l < L; ++l) {
+			pl[l].init (r->rate, r->nchan, isa);
+			pl[l].set_inpgain (signal_gain (SIG_OVERLOAD));
+			pl[l].set_threshold (-1);
+			pl[l].set_release (0.01);
+		}
+		r->kernel = pl[0].kernel_name ();
+	}
+
+	double sum  = 0;
+	double sum2 = 0;
+
+	/* the first pass is a warm-up and not counted */
+	for (int k = -1; k < reps; ++k) {
+		const double t0 = walltime ();
+		for (int i = 0; i < n; i += r->blocksize) {
+			const int ns = n - i < r->blocksize ? n - i : r->blocksize;
+			for (int l = 0; l < L; ++l) {
+				for (int c = 0; c < r->nchan; ++c) {
+					ip[l][c] = inp[l][c] + i;
+					op[l][c] = out[l][c] + i;
+				}
+			}
+			if (pb) {
+				pb->process_batch (ns, ip, op);
+			} else {
+				for (int l = 0; l < L; ++l) {
+					pl[l].process (ns, ip[l], op[l]);
+				}
+			}
+		}
+		const double ns = 1e9 * (walltime () - t0) / ((double)n * r->nchan * L);
+		if (k >= 0) {
+			sum += ns;
+			sum2 += ns * ns;
+		}
+	}
+
+	r->ns      = sum / reps;
+	r->stddev  = reps > 1 ? sqrt (fmax (0, (sum2 - sum * sum / reps) / (reps - 1))) : 0;
+	r->streams = 1e9 / (r->ns * r->nchan * r->rate);
+
+	delete pb;
+	delete[] pl;
+	for (int l = 0; l < L; ++l) {
+		for (int c = 0; c < r->nchan; ++c) {
+			delete[] inp[l][c];
+			delete[] out[l][c];
+		}
+		delete[] inp[l];
+		delete[] out[l];
+		delete[] ip[l];
+		delete[] op[l];
+	}
+	delete[] inp;
+	delete[] out;
+	delete[] ip;
+	delete[] op;
+}
+
+static void
+print_csv (FILE* f, const Result* r, int n)
+{
+	fprintf (f, "kernel,rate,channels,blocksize,truepeak,tp_lazy,bypass,lookahead_ms,latency,signal,ns_per_sample,ns_stddev,realtime,tp_chunks,tp_skipped\n");
+	for (int i = 0; i < n; ++i, ++r) {
+		fprintf (f, "%s,%d,%d,%d,%d,%d,%d,%.2f,%d,%s,%.3f,%.3f,%.1f,%llu,%llu\n",
+		         r->kernel, r->rate, r->nchan, r->blocksize, r->truepeak ? 1 : 0, r->tplazy ? 1 : 0, r->bypass ? 1 : 0,
+		         r->lookahead, r->latency, signal_names[r->signal], r->ns, r->stddev, r->realtime,
+		         (unsigned long long)r->tpchunks, (unsigned long long)r->tpskipped);
+	}
+}
+
+static void
+print_json (FILE* f, const Result* r, int n, double dur, int reps)
+{
+	fprintf (f, "{\n  \"version\": \"%s\",\n  \"duration\": %g,\n  \"repetitions\": %d,\n  \"results\": [\n",
+	         VERSION, dur, reps);
+	for (int i = 0; i < n; ++i, ++r) {
+		fprintf (f, "    {\"kernel\": \"%s\", \"rate\": %d, \"channels\": %d, \"blocksize\": %d, \"truepeak\": %s, \"tp_lazy\": %s, \"bypass\": %s, "
+		            "\"lookahead_ms\": %.2f, \"latency\": %d, "
+		            "\"signal\": \"%s\", \"ns_per_sample\": %.3f, \"ns_stddev\": %.3f, \"realtime\": %.1f, "
+		            "\"tp_chunks\": %llu, \"tp_skipped\": %llu}%s\n",
+		         r->kernel, r->rate, r->nchan, r->blocksize, r->truepeak ? "true" : "false", r->tplazy ? "true" : "false",
+		         r->bypass ? "true" : "false", r->lookahead, r->latency, signal_names[r->signal], r->ns, r->stddev, r->realtime,
+		         (unsigned long long)r->tpchunks, (unsigned long long)r->tpskipped, i + 1 < n ? "," : "");
+	}
+	fprintf (f, "  ]\n}\n");
+}
+
+static void
+print_lanes_csv (FILE* f, const LaneResult* r, int n)
+{
+	fprintf (f, "kernel,rate,channels,blocksize,lanes,engine,ns_per_sample,ns_stddev,streams_per_core\n");
+	for (int i = 0; i < n; ++i, ++r) {
+		fprintf (f, "%s,%d,%d,%d,%d,%s,%.3f,%.3f,%.1f\n",
+		         r->kernel, r->rate, r->nchan, r->blocksize, r->lanes, r->batch ? "batch" : "peaklim",
+		         r->ns, r->stddev, r->streams);
+	}
+}
+
+static void
+print_lanes_json (FILE* f, const LaneResult* r, int n, double dur, int reps)
+{
+	fprintf (f, "{\n  \"version\": \"%s\",\n  \"duration\": %g,\n  \"repetitions\": %d,\n  \"results\": [\n",
+	         VERSION, dur, reps);
+	for (int i = 0; i < n; ++i, ++r) {
+		fprintf (f, "    {\"kernel\": \"%s\", \"rate\": %d, \"channels\": %d, \"blocksize\": %d, \"lanes\": %d, "
+		            "\"engine\": \"%s\", \"ns_per_sample\": %.3f, \"ns_stddev\": %.3f, \"streams_per_core\": %.1f}%s\n",
+		         r->kernel, r->rate, r->nchan, r->blocksize, r->lanes, r->batch ? "batch" : "peaklim",
+		         r->ns, r->stddev, r->streams, i + 1 < n ? "," : "");
+	}
+	fprintf (f, "  ]\n}\n");
+}
+
+static void
+usage (int status)
+{
+	printf ("dpl-bench - Peaklim throughput benchmark.\n\n");
+	printf ("Usage: dpl-bench [ OPTIONS ]\n\n");
+	printf ("Options:\n"
+	        " -b, --bypass             measure bypassed instances\n"
+	        " -d, --duration <sec>     audio per measurement (default: 1)\n"
+	        " -n, --repeat <num>       measurements per configuration (default: 5)\n"
+	        " -f, --format <fmt>       csv or json (default: csv)\n"
+	        " -k, --kernel <isa>       scalar, sse2, avx2, avx512 (default: best)\n"
+	        " -l, --lookahead          sweep the look-ahead time, 0.25 .. 10 ms\n"
+	        "                          (default: 1.2 ms only)\n"
+	        " -L, --lanes              compare the batch engine (4, 8, 16 streams)\n"
+	        "                          to as many separate limiters instead\n"
+	        " -o, --output <file>      write results to file (default: stdout)\n"
+	        " -q, --quick              44.1k, 96k, 192k stereo, 64 and 1024 frames only\n"
+	        " -t, --tp-full            interpolate every true-peak chunk, do not skip\n"
+	        "                          those far below the threshold (lazy, default)\n"
+	        " -h, --help               display this help and exit\n"
+	        "\n");
+	printf ("Every combination of sample-rate, channel count, block size, true-peak,\n"
+	        "look-ahead and test signal is measured. ns_per_sample is the time per\n"
+	        "sample and channel, averaged over the repetitions; ns_stddev its standard\n"
+	        "deviation. latency is the resulting delay in samples.\n"
+	        "tp_chunks is the number of chunks (per channel) checked for true-peak,\n"
+	        "over all passes including the warm-up, tp_skipped how many of those\n"
+	        "were far enough below the threshold to skip the interpolation.\n\n");
+	printf ("With --lanes, the overload signal is processed without true-peak, by\n"
+	        "one PeaklimBatch or by looping over the same number of Peaklim instances.\n"
+	        "streams_per_core is the number of streams that one CPU core can process\n"
+	        "in realtime.\n");
+	exit (status);
+}
+
+static struct option const long_options[] = {
+	{ "bypass", no_argument, 0, 'b' },
+	{ "duration", required_argument, 0, 'd' },
+	{ "repeat", required_argument, 0, 'n' },
+	{ "format", required_argument, 0, 'f' },
+	{ "kernel", required_argument, 0, 'k' },
+	{ "lookahead", no_argument, 0, 'l' },
+	{ "lanes", no_argument, 0, 'L' },
+	{ "output", required_argument, 0, 'o' },
+	{ "quick", no_argument, 0, 'q' },
+	{ "tp-full", no_argument, 0, 't' },
+	{ "help", no_argument, 0, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+static bool
+in_quick_set (int rate, int nchan, int blocksize)
+{
+	return (rate == 44100 || rate == 96000 || rate == 192000) && nchan == 2 && (blocksize == 64 || blocksize == 1024);
+}
+
+static FILE*
+open_output (const char* ofn)
+{
+	FILE* f = ofn ? fopen (ofn, "w") : stdout;
+	if (!f) {
+		fprintf (stderr, "Cannot write to '%s'\n", ofn);
+	}
+	return f;
+}
+
+static int
+bench_lanes_main (int isa, double dur, int reps, bool quick, bool json, const char* ofn)
+{
+	int total = 0;
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (size_t ci = 0; ci < NELEM (channels); ++ci) {
+			for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+				if (!quick || in_quick_set (rates[ri], channels[ci], blocksizes[bi])) {
+					total += 2 * NELEM (lanes);
+				}
+			}
+		}
+	}
+
+	LaneResult* res = new LaneResult[total];
+	int         n   = 0;
+
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (size_t ci = 0; ci < NELEM (channels); ++ci) {
+			for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+				if (quick && !in_quick_set (rates[ri], channels[ci], blocksizes[bi])) {
+					continue;
+				}
+				for (size_t li = 0; li < NELEM (lanes); ++li) {
+					for (int batch = 0; batch < 2; ++batch) {
+						LaneResult* r = &res[n++];
+						r->rate       = rates[ri];
+						r->nchan      = channels[ci];
+						r->blocksize  = blocksizes[bi];
+						r->lanes      = lanes[li];
+						r->batch      = batch;
+						bench_lanes (r, isa, dur, reps);
+						fprintf (stderr, "\r%d/%d", n, total);
+					}
+				}
+			}
+		}
+	}
+	fprintf (stderr, "\n");
+
+	FILE* f = open_output (ofn);
+	if (!f) {
+		delete[] res;
+		return EXIT_FAILURE;
+	}
+	if (json) {
+		print_lanes_json (f, res, n, dur, reps);
+	} else {
+		print_lanes_csv (f, res, n);
+	}
+	if (ofn) {
+		fclose (f);
+	}
+
+	delete[] res;
+	return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char** argv)
+{
+	double      dur    = 1;
+	int         reps   = 5;
+	bool        json   = false;
+	bool        quick  = false;
+	bool        bypass = false;
+	bool        sweep  = false;
+	bool        multi  = false;
+	bool        tplazy = true;
+	int         isa    = KERNEL_AUTO;
+	const char* ofn    = NULL;
+
+	int c;
+	while ((c = getopt_long (argc, argv,
+	                         "b"  /* bypass */
+	                         "d:" /* duration */
+	                         "n:" /* repeat */
+	                         "f:" /* format */
+	                         "k:" /* kernel */
+	                         "l"  /* lookahead */
+	                         "L"  /* lanes */
+	                         "o:" /* output */
+	                         "q"  /* quick */
+	                         "t"  /* tp-full */
+	                         "h", /* help */
+	                         long_options, (int*)0)) != EOF) {
+		switch (c) {
+			case 'b':
+				bypass = true;
+				break;
+			case 'd':
+				dur = atof (optarg);
+				break;
+			case 'n':
+				reps = atoi (optarg);
+				break;
+			case 'f':
+				if (!strcmp (optarg, "json")) {
+					json = true;
+				} else if (!strcmp (optarg, "csv")) {
+					json = false;
+				} else {
+					fprintf (stderr, "Invalid format '%s'\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'k':
+				if ((isa = dsp_kernel_isa (optarg)) == KERNEL_AUTO) {
+					fprintf (stderr, "Unknown kernel '%s'\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 'l':
+				sweep = true;
+				break;
+			case 'L':
+				multi = true;
+				break;
+			case 'o':
+				ofn = optarg;
+				break;
+			case 'q':
+				quick = true;
+				break;
+			case 't':
+				tplazy = false;
+				break;
+			case 'h':
+				usage (EXIT_SUCCESS);
+				break;
+			default:
+				usage (EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if (dur <= 0 || reps < 1) {
+		usage (EXIT_FAILURE);
+	}
+
+	if (multi) {
+		return bench_lanes_main (isa, dur, reps, quick, json, ofn);
+	}
+
+	const float* las = sweep ? lookaheads : &lookaheads[2];
+	const int    nla = sweep ? NELEM (lookaheads) : 1;
+
+	int total = 0;
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (size_t ci = 0; ci < NELEM (channels); ++ci) {
+			for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+				if (!quick || in_quick_set (rates[ri], channels[ci], blocksizes[bi])) {
+					total += 2 * nla * SIG_LAST;
+				}
+			}
+		}
+	}
+
+	Result* res = new Result[total];
+	int     n   = 0;
+
+	for (size_t ri = 0; ri < NELEM (rates); ++ri) {
+		for (size_t ci = 0; ci < NELEM (channels); ++ci) {
+			for (size_t bi = 0; bi < NELEM (blocksizes); ++bi) {
+				if (quick && !in_quick_set (rates[ri], channels[ci], blocksizes[bi])) {
+					continue;
+				}
+				for (int tp = 0; tp < 2; ++tp) {
+					for (int li = 0; li < nla; ++li) {
+						for (int sig = 0; sig < SIG_LAST; ++sig) {
+							Result* r    = &res[n++];
+							r->rate      = rates[ri];
+							r->nchan     = channels[ci];
+							r->blocksize = blocksizes[bi];
+							r->truepeak  = tp;
+							r->tplazy    = tplazy;
+							r->bypass    = bypass;
+							r->lookahead = las[li];
+							r->signal    = sig;
+							bench (r, isa, dur, reps);
+							fprintf (stderr, "\r%d/%d", n, total);
+						}
+					}
+				}
+			}
+		}
+	}
+	fprintf (stderr, "\n");
+
+	FILE* f = open_output (ofn);
+	if (!f) {
+		delete[] res;
+		return EXIT_FAILURE;
+	}
+	if (json) {
+		print_json (f, res, n, dur, reps);
+	} else {
+		print_csv (f, res, n);
+	}
+	if (ofn) {
+		fclose (f);
+	}
+
+	delete[] res;
+	return EXIT_SUCCESS;
+}
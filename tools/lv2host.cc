@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lv2host.h"
+
+#define ATOM_BUFSIZE 8192 // bytes, per atom port
+
+LV2Host::LV2Host (void)
+    : ins (0)
+    , outs (0)
+    , nchan (0)
+    , notify_size (0)
+    , desc (0)
+    , handle (0)
+    , _lib (0)
+    , _n_urids (0)
+    , _n_otype (0)
+    , _n_set (0)
+    , _control (0)
+    , _notify (0)
+    , _error ("")
+{
+	memset (ctl, 0, sizeof (ctl));
+	memset (&uris, 0, sizeof (uris));
+
+	_map.handle = this;
+	_map.map    = map_uri;
+
+	_map_feature.URI  = LV2_URID__map;
+	_map_feature.data = &_map;
+}
+
+LV2Host::~LV2Host (void)
+{
+	unload ();
+	for (uint32_t i = 0; i < _n_urids; ++i) {
+		free (_urids[i]);
+	}
+}
+
+LV2_URID
+LV2Host::map_uri (LV2_URID_Map_Handle h, const char* uri)
+{
+	return ((LV2Host*)h)->map (uri);
+}
+
+LV2_URID
+LV2Host::map (const char* uri)
+{
+	for (uint32_t i = 0; i < _n_urids; ++i) {
+		if (!strcmp (_urids[i], uri)) {
+			return i + 1;
+		}
+	}
+	if (_n_urids == sizeof (_urids) / sizeof (_urids[0])) {
+		return 0;
+	}
+	_urids[_n_urids] = strdup (uri);
+	return ++_n_urids;
+}
+
+bool
+LV2Host::load (const char* path, const char* variant, double rate, uint32_t max_block)
+{
+	unload ();
+
+	if (!strcmp (variant, "mono")) {
+		nchan = 1;
+	} else if (!strcmp (variant, "stereo")) {
+		nchan = 2;
+	} else if (!strncmp (variant, "ch", 2) && atoi (variant + 2) > 0) {
+		nchan = atoi (variant + 2);
+	} else {
+		_error = "unknown plugin variant";
+		return false;
+	}
+
+	if (!(_lib = dlopen (path, RTLD_NOW | RTLD_LOCAL))) {
+		_error = dlerror ();
+		return false;
+	}
+
+	LV2_Descriptor_Function descriptor = (LV2_Descriptor_Function)dlsym (_lib, "lv2_descriptor");
+	if (!descriptor) {
+		_error = "no lv2_descriptor";
+		unload ();
+		return false;
+	}
+
+	char uri[128];
+	snprintf (uri, sizeof (uri), "%s%s", PLIM_URI, variant);
+	for (uint32_t i = 0; (desc = descriptor (i)); ++i) {
+		if (!strcmp (desc->URI, uri)) {
+			break;
+		}
+	}
+	if (!desc) {
+		_error = "plugin variant not found";
+		unload ();
+		return false;
+	}
+
+	const LV2_Feature* features[] = { &_map_feature, NULL };
+	if (!(handle = desc->instantiate (desc, rate, path, features))) {
+		_error = "instantiation failed";
+		unload ();
+		return false;
+	}
+
+	map_plim_uris (&_map, &uris);
+	lv2_atom_forge_init (&_forge, &_map);
+
+	ctl[PLIM_ENABLE]    = 1;
+	ctl[PLIM_GAIN]      = 0;
+	ctl[PLIM_THRESHOLD] = -1;
+	ctl[PLIM_RELEASE]   = 0.01;
+	ctl[PLIM_TRUEPEAK]  = 0;
+	ctl[PLIM_LOOKAHEAD] = 1.2;
+
+	_control = (uint64_t*)calloc (ATOM_BUFSIZE / 8, 8);
+	_notify  = (uint64_t*)calloc (ATOM_BUFSIZE / 8, 8);
+	ins      = (float**)calloc (nchan, sizeof (float*));
+	outs     = (float**)calloc (nchan, sizeof (float*));
+
+	desc->connect_port (handle, PLIM_ATOM_CONTROL, _control);
+	desc->connect_port (handle, PLIM_ATOM_NOTIFY, _notify);
+	for (uint32_t p = PLIM_ENABLE; p < PLIM_NCTRL; ++p) {
+		desc->connect_port (handle, plim_port_index (nchan, p), &ctl[p]);
+	}
+	for (uint32_t c = 0; c < nchan; ++c) {
+		ins[c]  = (float*)calloc (max_block, sizeof (float));
+		outs[c] = (float*)calloc (max_block, sizeof (float));
+		desc->connect_port (handle, PLIM_INPUT0 + 2 * c, ins[c]);
+		desc->connect_port (handle, PLIM_OUTPUT0 + 2 * c, outs[c]);
+	}
+
+	if (desc->activate) {
+		desc->activate (handle);
+	}
+	return true;
+}
+
+void
+LV2Host::unload (void)
+{
+	if (handle) {
+		if (desc->deactivate) {
+			desc->deactivate (handle);
+		}
+		desc->cleanup (handle);
+	}
+	for (uint32_t c = 0; c < nchan && ins; ++c) {
+		free (ins[c]);
+		free (outs[c]);
+	}
+	free (ins);
+	free (outs);
+	free (_control);
+	free (_notify);
+	if (_lib) {
+		dlclose (_lib);
+	}
+	handle   = 0;
+	desc     = 0;
+	ins      = 0;
+	outs     = 0;
+	_control = 0;
+	_notify  = 0;
+	_lib     = 0;
+}
+
+bool
+LV2Host::send (LV2_URID otype)
+{
+	if (_n_otype == sizeof (_otype) / sizeof (_otype[0])) {
+		return false;
+	}
+	_otype[_n_otype++] = otype;
+	return true;
+}
+
+bool
+LV2Host::send_set (LV2_URID property, float value, uint32_t frame)
+{
+	if (_n_set == sizeof (_sprop) / sizeof (_sprop[0])) {
+		return false;
+	}
+	/* insert sorted, after events at the same frame */
+	uint32_t i = _n_set++;
+	for (; i > 0 && _sframe[i - 1] > frame; --i) {
+		_sprop[i]  = _sprop[i - 1];
+		_sval[i]   = _sval[i - 1];
+		_sframe[i] = _sframe[i - 1];
+	}
+	_sprop[i]  = property;
+	_sval[i]   = value;
+	_sframe[i] = frame;
+	return true;
+}
+
+void
+LV2Host::prepare (void)
+{
+	/* control: queued messages at time 0 */
+	LV2_Atom_Forge_Frame seq;
+	lv2_atom_forge_set_buffer (&_forge, (uint8_t*)_control, ATOM_BUFSIZE);
+	lv2_atom_forge_sequence_head (&_forge, &seq, 0);
+	for (uint32_t i = 0; i < _n_otype; ++i) {
+		LV2_Atom_Forge_Frame frame;
+		lv2_atom_forge_frame_time (&_forge, 0);
+		x_forge_object (&_forge, &frame, 1, _otype[i]);
+		lv2_atom_forge_pop (&_forge, &frame);
+	}
+	/* then patch:Set, in order */
+	for (uint32_t i = 0; i < _n_set; ++i) {
+		LV2_Atom_Forge_Frame frame;
+		lv2_atom_forge_frame_time (&_forge, _sframe[i]);
+		x_forge_object (&_forge, &frame, 1, uris.patch_Set);
+		lv2_atom_forge_property_head (&_forge, uris.patch_property, 0);
+		lv2_atom_forge_urid (&_forge, _sprop[i]);
+		lv2_atom_forge_property_head (&_forge, uris.patch_value, 0);
+		lv2_atom_forge_float (&_forge, _sval[i]);
+		lv2_atom_forge_pop (&_forge, &frame);
+	}
+	lv2_atom_forge_pop (&_forge, &seq);
+	_n_otype = 0;
+	_n_set   = 0;
+
+	/* notify: the plugin writes up to atom.size bytes */
+	LV2_Atom_Sequence* notify = (LV2_Atom_Sequence*)_notify;
+	notify->atom.size         = ATOM_BUFSIZE - sizeof (LV2_Atom);
+	notify->atom.type         = 0;
+}
+
+void
+LV2Host::run (uint32_t n_samples)
+{
+	prepare ();
+	desc->run (handle, n_samples);
+	notify_size = ((LV2_Atom_Sequence*)_notify)->atom.size;
+}
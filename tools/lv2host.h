@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LV2HOST_H
+#define _LV2HOST_H
+
+#ifdef HAVE_LV2_1_18_6
+#include <lv2/core/lv2.h>
+#else
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#endif
+
+#include "uris.h"
+
+/* Minimal host for the dpl.lv2 shared object, as used by the
+ * development tools: urid:map, control ports, the atom ports and
+ * audio buffers. Everything is allocated in load (), run () only
+ * prepares the atom ports and calls the plugin.
+ */
+class LV2Host
+{
+public:
+	LV2Host (void);
+	~LV2Host (void);
+
+	/* variant: mono, stereo, ch4, ch6, ch8, ch16 */
+	bool load (const char* path, const char* variant, double rate, uint32_t max_block);
+	void unload (void);
+
+	/* prepare the atom ports and call the plugin's run () */
+	void run (uint32_t n_samples);
+
+	/* only prepare the atom ports, for timing desc->run () itself */
+	void prepare (void);
+
+	/* queue a message (object without properties, e.g. ui_on)
+	 * for the next run ()
+	 */
+	bool send (LV2_URID otype);
+
+	/* queue a patch:Set of property (e.g. uris.p_gain) to value at
+	 * the given frame of the next run (). Events are sorted by frame,
+	 * after the messages above. The value is sent as is, also when
+	 * it is out of range.
+	 */
+	bool send_set (LV2_URID property, float value, uint32_t frame);
+
+	LV2_URID map (const char* uri);
+
+	/* control ports, indexed by PortIndex and PortIndexExt */
+	float ctl[PLIM_NCTRL];
+
+	float**     ins;
+	float**     outs;
+	uint32_t    nchan;
+	PlimLV2URIs uris;
+
+	/* bytes written to the notify port by the last run () */
+	uint32_t notify_size;
+
+	const char*
+	error () const
+	{
+		return _error;
+	}
+
+	/* the instance and its descriptor, e.g. to call connect_port () */
+	const LV2_Descriptor* desc;
+	LV2_Handle            handle;
+
+private:
+	static LV2_URID map_uri (LV2_URID_Map_Handle, const char*);
+
+	void*          _lib;
+	char*          _urids[64];
+	uint32_t       _n_urids;
+	LV2_URID_Map   _map;
+	LV2_Feature    _map_feature;
+	LV2_URID       _otype[8];
+	uint32_t       _n_otype;
+	LV2_URID       _sprop[16];
+	float          _sval[16];
+	uint32_t       _sframe[16];
+	uint32_t       _n_set;
+	uint64_t*      _control; // LV2_Atom_Sequence, 8 byte aligned
+	uint64_t*      _notify;
+	LV2_Atom_Forge _forge;
+	const char*    _error;
+};
+
+#endif
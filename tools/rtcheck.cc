@@ -0,0 +1,776 @@
+/* dpl-rtcheck -- assert that run () and connect_port () are real-time safe
+ *
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The functions below replace the ones of libc/libstdc++ for the
+ * plugin (the executable is linked with -rdynamic, and symbols of the
+ * executable take precedence). While "armed", i.e. during the plugin's
+ * run () and connect_port (), every call is recorded as a violation,
+ * and then forwarded to the original function.
+ *
+ * This catches calls made by the plugin and the libraries it uses,
+ * but not calls from inside libc to itself, nor system-calls that do
+ * not go through these wrappers. Memory allocation uses glibc's
+ * __libc_* entry points, since dlsym () may allocate.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <new>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lv2host.h"
+
+#define EXPORT __attribute__ ((visibility ("default")))
+
+extern "C" {
+extern void* __libc_malloc (size_t);
+extern void* __libc_calloc (size_t, size_t);
+extern void* __libc_realloc (void*, size_t);
+extern void* __libc_memalign (size_t, size_t);
+extern void  __libc_free (void*);
+}
+
+/* ****************************************************************************
+ * violation log, preallocated
+ */
+
+#define MAXFN 64
+
+struct Violation {
+	const char* fn;
+	const char* context; // plugin function
+	uint32_t    count;
+	uint64_t    first; // call number of the first occurrence
+};
+
+static __thread bool armed   = false;
+static const char*   context = "";
+static uint64_t      callnum = 0;
+static Violation     violations[MAXFN];
+static uint32_t      n_violations = 0;
+
+static void
+violation (const char* fn)
+{
+	if (!armed) {
+		return;
+	}
+	/* no recursion, e.g. realloc calling malloc */
+	armed = false;
+	uint32_t i;
+	for (i = 0; i < n_violations; ++i) {
+		if (violations[i].fn == fn && violations[i].context == context) {
+			break;
+		}
+	}
+	if (i == n_violations && i < MAXFN) {
+		violations[i].fn      = fn;
+		violations[i].context = context;
+		violations[i].count   = 0;
+		violations[i].first   = callnum;
+		++n_violations;
+	}
+	if (i < MAXFN) {
+		++violations[i].count;
+	}
+	armed = true;
+}
+
+/* ****************************************************************************
+ * interposed functions
+ */
+
+/* other functions are resolved once, before anything is armed */
+#define REAL(NAME) static __typeof__ (NAME)* real_##NAME = NULL;
+
+REAL (pthread_mutex_lock)
+REAL (pthread_mutex_trylock)
+REAL (pthread_mutex_unlock)
+REAL (pthread_cond_wait)
+REAL (pthread_cond_timedwait)
+REAL (pthread_cond_signal)
+REAL (pthread_cond_broadcast)
+REAL (sem_wait)
+REAL (sem_post)
+REAL (read)
+REAL (write)
+REAL (open)
+REAL (close)
+REAL (fopen)
+REAL (fwrite)
+REAL (fflush)
+REAL (puts)
+REAL (vfprintf)
+REAL (usleep)
+REAL (nanosleep)
+REAL (sched_yield)
+REAL (mmap)
+REAL (munmap)
+REAL (mlock)
+REAL (syscall)
+
+#define RESOLVE(NAME) real_##NAME = (__typeof__ (NAME)*)dlsym (RTLD_NEXT, #NAME);
+
+static bool
+resolve (void)
+{
+	RESOLVE (pthread_mutex_lock)
+	RESOLVE (pthread_mutex_trylock)
+	RESOLVE (pthread_mutex_unlock)
+	RESOLVE (pthread_cond_wait)
+	RESOLVE (pthread_cond_timedwait)
+	RESOLVE (pthread_cond_signal)
+	RESOLVE (pthread_cond_broadcast)
+	RESOLVE (sem_wait)
+	RESOLVE (sem_post)
+	RESOLVE (read)
+	RESOLVE (write)
+	RESOLVE (open)
+	RESOLVE (close)
+	RESOLVE (fopen)
+	RESOLVE (fwrite)
+	RESOLVE (fflush)
+	RESOLVE (puts)
+	RESOLVE (vfprintf)
+	RESOLVE (usleep)
+	RESOLVE (nanosleep)
+	RESOLVE (sched_yield)
+	RESOLVE (mmap)
+	RESOLVE (munmap)
+	RESOLVE (mlock)
+	RESOLVE (syscall)
+	return real_write && real_vfprintf && real_pthread_mutex_lock;
+}
+
+extern "C" {
+
+EXPORT void*
+malloc (size_t size)
+{
+	violation ("malloc");
+	return __libc_malloc (size);
+}
+
+EXPORT void*
+calloc (size_t n, size_t size)
+{
+	violation ("calloc");
+	return __libc_calloc (n, size);
+}
+
+EXPORT void*
+realloc (void* p, size_t size)
+{
+	violation ("realloc");
+	return __libc_realloc (p, size);
+}
+
+EXPORT void
+free (void* p)
+{
+	violation ("free");
+	__libc_free (p);
+}
+
+EXPORT int
+posix_memalign (void** p, size_t align, size_t size)
+{
+	violation ("posix_memalign");
+	*p = __libc_memalign (align, size);
+	return *p ? 0 : ENOMEM;
+}
+
+EXPORT void*
+aligned_alloc (size_t align, size_t size)
+{
+	violation ("aligned_alloc");
+	return __libc_memalign (align, size);
+}
+
+EXPORT void*
+memalign (size_t align, size_t size)
+{
+	violation ("memalign");
+	return __libc_memalign (align, size);
+}
+
+EXPORT int
+pthread_mutex_lock (pthread_mutex_t* m)
+{
+	violation ("pthread_mutex_lock");
+	return real_pthread_mutex_lock (m);
+}
+
+EXPORT int
+pthread_mutex_trylock (pthread_mutex_t* m)
+{
+	violation ("pthread_mutex_trylock");
+	return real_pthread_mutex_trylock (m);
+}
+
+EXPORT int
+pthread_mutex_unlock (pthread_mutex_t* m)
+{
+	violation ("pthread_mutex_unlock");
+	return real_pthread_mutex_unlock (m);
+}
+
+EXPORT int
+pthread_cond_wait (pthread_cond_t* c, pthread_mutex_t* m)
+{
+	violation ("pthread_cond_wait");
+	return real_pthread_cond_wait (c, m);
+}
+
+EXPORT int
+pthread_cond_timedwait (pthread_cond_t* c, pthread_mutex_t* m, const struct timespec* t)
+{
+	violation ("pthread_cond_timedwait");
+	return real_pthread_cond_timedwait (c, m, t);
+}
+
+EXPORT int
+pthread_cond_signal (pthread_cond_t* c)
+{
+	violation ("pthread_cond_signal");
+	return real_pthread_cond_signal (c);
+}
+
+EXPORT int
+pthread_cond_broadcast (pthread_cond_t* c)
+{
+	violation ("pthread_cond_broadcast");
+	return real_pthread_cond_broadcast (c);
+}
+
+EXPORT int
+sem_wait (sem_t* s)
+{
+	violation ("sem_wait");
+	return real_sem_wait (s);
+}
+
+EXPORT int
+sem_post (sem_t* s)
+{
+	violation ("sem_post");
+	return real_sem_post (s);
+}
+
+EXPORT ssize_t
+read (int fd, void* buf, size_t n)
+{
+	violation ("read");
+	return real_read (fd, buf, n);
+}
+
+EXPORT ssize_t
+write (int fd, const void* buf, size_t n)
+{
+	violation ("write");
+	return real_write (fd, buf, n);
+}
+
+EXPORT int
+open (const char* path, int flags, ...)
+{
+	violation ("open");
+	va_list ap;
+	va_start (ap, flags);
+	mode_t mode = (flags & O_CREAT) ? va_arg (ap, int) : 0;
+	va_end (ap);
+	return real_open (path, flags, mode);
+}
+
+EXPORT int
+close (int fd)
+{
+	violation ("close");
+	return real_close (fd);
+}
+
+EXPORT FILE*
+fopen (const char* path, const char* mode)
+{
+	violation ("fopen");
+	return real_fopen (path, mode);
+}
+
+EXPORT size_t
+fwrite (const void* p, size_t size, size_t n, FILE* f)
+{
+	violation ("fwrite");
+	return real_fwrite (p, size, n, f);
+}
+
+EXPORT int
+fflush (FILE* f)
+{
+	violation ("fflush");
+	return real_fflush (f);
+}
+
+EXPORT int
+puts (const char* s)
+{
+	violation ("puts");
+	return real_puts (s);
+}
+
+EXPORT int
+vfprintf (FILE* f, const char* fmt, va_list ap)
+{
+	violation ("vfprintf");
+	return real_vfprintf (f, fmt, ap);
+}
+
+EXPORT int
+fprintf (FILE* f, const char* fmt, ...)
+{
+	violation ("fprintf");
+	va_list ap;
+	va_start (ap, fmt);
+	int rv = real_vfprintf (f, fmt, ap);
+	va_end (ap);
+	return rv;
+}
+
+EXPORT int
+printf (const char* fmt, ...)
+{
+	violation ("printf");
+	va_list ap;
+	va_start (ap, fmt);
+	int rv = real_vfprintf (stdout, fmt, ap);
+	va_end (ap);
+	return rv;
+}
+
+EXPORT int
+usleep (useconds_t us)
+{
+	violation ("usleep");
+	return real_usleep (us);
+}
+
+EXPORT int
+nanosleep (const struct timespec* req, struct timespec* rem)
+{
+	violation ("nanosleep");
+	return real_nanosleep (req, rem);
+}
+
+EXPORT int
+sched_yield (void)
+{
+	violation ("sched_yield");
+	return real_sched_yield ();
+}
+
+EXPORT void*
+mmap (void* addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+	violation ("mmap");
+	return real_mmap (addr, len, prot, flags, fd, off);
+}
+
+EXPORT int
+munmap (void* addr, size_t len)
+{
+	violation ("munmap");
+	return real_munmap (addr, len);
+}
+
+EXPORT int
+mlock (const void* addr, size_t len)
+{
+	violation ("mlock");
+	return real_mlock (addr, len);
+}
+
+EXPORT long
+syscall (long nr, ...)
+{
+	violation ("syscall");
+	va_list ap;
+	va_start (ap, nr);
+	long a[6];
+	for (int i = 0; i < 6; ++i) {
+		a[i] = va_arg (ap, long);
+	}
+	va_end (ap);
+	return real_syscall (nr, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+} // extern "C"
+
+EXPORT void*
+operator new (size_t size)
+{
+	violation ("operator new");
+	void* p = __libc_malloc (size);
+	if (!p) {
+		throw std::bad_alloc ();
+	}
+	return p;
+}
+
+EXPORT void*
+operator new[] (size_t size)
+{
+	violation ("operator new[]");
+	void* p = __libc_malloc (size);
+	if (!p) {
+		throw std::bad_alloc ();
+	}
+	return p;
+}
+
+EXPORT void*
+operator new (size_t size, const std::nothrow_t&) throw ()
+{
+	violation ("operator new");
+	return __libc_malloc (size);
+}
+
+EXPORT void*
+operator new[] (size_t size, const std::nothrow_t&) throw ()
+{
+	violation ("operator new[]");
+	return __libc_malloc (size);
+}
+
+EXPORT void
+operator delete (void* p) throw ()
+{
+	violation ("operator delete");
+	__libc_free (p);
+}
+
+EXPORT void
+operator delete[] (void* p) throw ()
+{
+	violation ("operator delete[]");
+	__libc_free (p);
+}
+
+EXPORT void
+operator delete (void* p, size_t) throw ()
+{
+	violation ("operator delete");
+	__libc_free (p);
+}
+
+EXPORT void
+operator delete[] (void* p, size_t) throw ()
+{
+	violation ("operator delete[]");
+	__libc_free (p);
+}
+
+/* ****************************************************************************
+ * test driver
+ */
+
+static uint32_t
+rnd (uint32_t* s)
+{
+	*s = *s * 1664525 + 1013904223;
+	return *s >> 8;
+}
+
+static float
+rndf (uint32_t* s, float lo, float hi)
+{
+	return lo + (hi - lo) * rnd (s) / 16777216.f;
+}
+
+/* automation: 1..8 patch:Set of gain, threshold or release at random
+ * frames of the next n samples. Values are up to the range beyond
+ * either end, and some are NaN.
+ */
+static void
+automate (LV2Host* h, uint32_t* seed, uint32_t n)
+{
+	const LV2_URID     prop[3] = { h->uris.p_gain, h->uris.p_threshold, h->uris.p_release };
+	static const float lo[3]   = { -10.f, -10.f, .001f };
+	static const float hi[3]   = { 30.f, 0.f, 1.f };
+
+	const uint32_t cnt = 1 + rnd (seed) % 8;
+	for (uint32_t i = 0; i < cnt; ++i) {
+		const int   p = rnd (seed) % 3;
+		const float r = hi[p] - lo[p];
+		const float v = rnd (seed) % 16 ? rndf (seed, lo[p] - r, hi[p] + r) : NAN;
+		h->send_set (prop[p], v, rnd (seed) % n);
+	}
+}
+
+static void
+arm (const char* ctx)
+{
+	context = ctx;
+	armed   = true;
+}
+
+static void
+disarm (void)
+{
+	armed = false;
+}
+
+/* make sure that the interposition works at all */
+static bool
+selftest (void)
+{
+	void* (*volatile m) (size_t) = malloc;
+	arm ("selftest");
+	void* p = m (16);
+	disarm ();
+	__libc_free (p);
+	const bool ok = n_violations == 1 && !strcmp (violations[0].fn, "malloc");
+	n_violations  = 0;
+	return ok;
+}
+
+/* Run the plugin variant, changing every control, flipping true-peak
+ * and enable, showing/hiding the GUI, sending patch:Set automation and
+ * re-connecting audio ports.
+ * The very first run () after instantiation is included.
+ */
+static bool
+check (const char* path, const char* variant, int rate, uint32_t bs, uint32_t ncalls, uint32_t seed)
+{
+	LV2Host host;
+	if (!host.load (path, variant, rate, bs)) {
+		fprintf (stderr, "Cannot load '%s': %s\n", path, host.error ());
+		return false;
+	}
+
+	/* alternate buffers for connect_port () */
+	float** alt = (float**)calloc (host.nchan, sizeof (float*));
+	for (uint32_t c = 0; c < host.nchan; ++c) {
+		alt[c] = (float*)calloc (bs, sizeof (float));
+	}
+
+	n_violations = 0;
+
+	for (uint32_t i = 0; i < ncalls; ++i) {
+		callnum = i;
+
+		const uint32_t n = 1 + rnd (&seed) % bs;
+
+		switch (i < 16 ? i : rnd (&seed) % 64) {
+			case 1:
+				host.send (host.uris.ui_on);
+				break;
+			case 2:
+				host.ctl[PLIM_TRUEPEAK] = host.ctl[PLIM_TRUEPEAK] > 0 ? 0 : 1;
+				break;
+			case 3:
+				host.ctl[PLIM_ENABLE] = host.ctl[PLIM_ENABLE] > 0 ? 0 : 1;
+				break;
+			case 4:
+				host.send (host.uris.ui_off);
+				break;
+			case 5:
+				host.ctl[PLIM_GAIN] = rndf (&seed, -10, 30);
+				break;
+			case 6:
+				host.ctl[PLIM_THRESHOLD] = rndf (&seed, -10, 0);
+				break;
+			case 7:
+				host.ctl[PLIM_RELEASE] = rndf (&seed, 0.001, 1);
+				break;
+			case 8:
+				host.ctl[PLIM_LOOKAHEAD] = rndf (&seed, 0.25, 10);
+				break;
+			case 9:
+				arm ("connect_port");
+				for (uint32_t c = 0; c < host.nchan; ++c) {
+					float* t = host.ins[c];
+					host.desc->connect_port (host.handle, PLIM_INPUT0 + 2 * c, alt[c]);
+					host.ins[c] = alt[c];
+					alt[c]      = t;
+				}
+				disarm ();
+				break;
+			case 10:
+				/* in-place processing */
+				arm ("connect_port");
+				for (uint32_t c = 0; c < host.nchan; ++c) {
+					host.desc->connect_port (host.handle, PLIM_OUTPUT0 + 2 * c, host.ins[c]);
+				}
+				disarm ();
+				break;
+			case 11:
+				arm ("connect_port");
+				for (uint32_t c = 0; c < host.nchan; ++c) {
+					host.desc->connect_port (host.handle, PLIM_OUTPUT0 + 2 * c, host.outs[c]);
+				}
+				disarm ();
+				break;
+			case 12:
+			case 13:
+				automate (&host, &seed, n);
+				break;
+			default:
+				break;
+		}
+
+		const float gain = (i / 1000) & 1 ? 4.f : .1f;
+		for (uint32_t c = 0; c < host.nchan; ++c) {
+			for (uint32_t k = 0; k < n; ++k) {
+				host.ins[c][k] = gain * rndf (&seed, -1, 1);
+			}
+		}
+
+		host.prepare ();
+		arm ("run");
+		host.desc->run (host.handle, n);
+		disarm ();
+	}
+
+	for (uint32_t c = 0; c < host.nchan; ++c) {
+		free (alt[c]);
+	}
+	free (alt);
+
+	printf ("%-8s %u calls: ", variant, ncalls);
+	if (n_violations == 0) {
+		printf ("OK\n");
+		return true;
+	}
+	printf ("FAIL\n");
+	for (uint32_t i = 0; i < n_violations; ++i) {
+		printf ("  %s () called %u times in %s (), first in call %lu\n",
+		        violations[i].fn, violations[i].count, violations[i].context, (unsigned long)violations[i].first);
+	}
+	return false;
+}
+
+static void
+usage (int status)
+{
+	printf ("dpl-rtcheck - Check that dpl.lv2 run () is real-time safe.\n\n");
+	printf ("Usage: dpl-rtcheck [ OPTIONS ] [ <plugin.so> ]\n\n");
+	printf ("Options:\n"
+	        " -c, --variant <name>     mono, stereo, ch4, ch6, ch8, ch16 (default: all)\n"
+	        " -r, --rate <Hz>          sample-rate (default: 48000)\n"
+	        " -b, --blocksize <num>    maximum samples per call (default: 1024)\n"
+	        " -n, --calls <num>        number of calls (default: 100000)\n"
+	        " -s, --seed <num>         random seed (default: 1)\n"
+	        " -h, --help               display this help and exit\n"
+	        "\n");
+	printf ("The plugin (default: build/dpl.so) is loaded, and run () is called while\n"
+	        "memory allocation, locks, sleeping and I/O functions are intercepted.\n"
+	        "The exit status is non-zero if any of those are used by run () or\n"
+	        "connect_port ().\n");
+	exit (status);
+}
+
+static struct option const long_options[] = {
+	{ "variant", required_argument, 0, 'c' },
+	{ "rate", required_argument, 0, 'r' },
+	{ "blocksize", required_argument, 0, 'b' },
+	{ "calls", required_argument, 0, 'n' },
+	{ "seed", required_argument, 0, 's' },
+	{ "help", no_argument, 0, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+int
+main (int argc, char** argv)
+{
+	const char* variant = NULL;
+	int         rate    = 48000;
+	uint32_t    bs      = 1024;
+	uint32_t    ncalls  = 100000;
+	uint32_t    seed    = 1;
+
+	int c;
+	while ((c = getopt_long (argc, argv,
+	                         "c:" /* variant */
+	                         "r:" /* rate */
+	                         "b:" /* blocksize */
+	                         "n:" /* calls */
+	                         "s:" /* seed */
+	                         "h", /* help */
+	                         long_options, (int*)0)) != EOF) {
+		switch (c) {
+			case 'c':
+				variant = optarg;
+				break;
+			case 'r':
+				rate = atoi (optarg);
+				break;
+			case 'b':
+				bs = atoi (optarg);
+				break;
+			case 'n':
+				ncalls = atoi (optarg);
+				break;
+			case 's':
+				seed = atoi (optarg);
+				break;
+			case 'h':
+				usage (EXIT_SUCCESS);
+				break;
+			default:
+				usage (EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if (rate < 8000 || bs < 1 || ncalls < 16 || optind + 1 < argc) {
+		usage (EXIT_FAILURE);
+	}
+
+	const char* path = optind < argc ? argv[optind] : "build/dpl.so";
+
+	if (!resolve () || !selftest ()) {
+		fprintf (stderr, "Function interposition does not work\n");
+		return EXIT_FAILURE;
+	}
+
+	static const char* variants[] = { "mono", "stereo", "ch4", "ch6", "ch8", "ch16", NULL };
+
+	bool ok = true;
+	if (variant) {
+		ok = check (path, variant, rate, bs, ncalls, seed);
+	} else {
+		for (int i = 0; variants[i]; ++i) {
+			ok &= check (path, variants[i], rate, bs, ncalls, seed);
+		}
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,347 @@
+/* dpl-wcet -- worst-case execution time of the plugin's run ()
+ *
+ * Copyright (C) 2021 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "lv2host.h"
+
+using namespace std;
+
+/* Input signals, each one is used for a few thousand consecutive calls */
+enum Stimulus {
+	STIM_SILENCE = 0,
+	STIM_NOISE,    // full-scale white noise
+	STIM_SINE,     // full-scale sine
+	STIM_IMPULSE,  // sparse full-scale spikes in silence
+	STIM_BURST,    // slowly decaying tone, then a full-scale burst:
+	               // the hold-windows (Histmin) fill and are flushed at once
+	STIM_DENORMAL, // tiny values
+	STIM_LAST
+};
+
+static const char* stim_names[] = { "silence", "noise", "sine", "impulse", "burst", "denormal" };
+
+struct Stats {
+	float*   t; // usec per call
+	uint8_t* stim;
+	uint32_t n;
+};
+
+static double
+walltime (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static uint32_t
+rnd (uint32_t* s)
+{
+	*s = *s * 1664525 + 1013904223;
+	return *s >> 8;
+}
+
+static float
+rndf (uint32_t* s, float lo, float hi)
+{
+	return lo + (hi - lo) * rnd (s) / 16777216.f;
+}
+
+static void
+generate (float* x, uint32_t n, int stim, uint64_t pos, int rate, uint32_t* seed)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		const double t = (double)(pos + i) / rate;
+		switch (stim) {
+			case STIM_SILENCE:
+				x[i] = 0;
+				break;
+			case STIM_NOISE:
+				x[i] = rndf (seed, -1, 1);
+				break;
+			case STIM_SINE:
+				x[i] = sin (2 * M_PI * 1000 * t);
+				break;
+			case STIM_IMPULSE:
+				x[i] = (rnd (seed) % 4096) == 0 ? 1 : 0;
+				break;
+			case STIM_BURST: {
+				const double p = fmod (t, 2.0);
+				x[i]           = p < 1.9 ? exp (-3 * p) * sin (2 * M_PI * 200 * t) : rndf (seed, -1, 1);
+			} break;
+			case STIM_DENORMAL:
+				x[i] = rndf (seed, -1e-38f, 1e-38f);
+				break;
+		}
+	}
+}
+
+/* automation: 1..8 patch:Set of gain, threshold or release at random
+ * frames of the next n samples. Values are up to the range beyond
+ * either end, and some are NaN.
+ */
+static void
+automate (LV2Host* h, uint32_t* seed, uint32_t n)
+{
+	const LV2_URID     prop[3] = { h->uris.p_gain, h->uris.p_threshold, h->uris.p_release };
+	static const float lo[3]   = { -10.f, -10.f, .001f };
+	static const float hi[3]   = { 30.f, 0.f, 1.f };
+
+	const uint32_t cnt = 1 + rnd (seed) % 8;
+	for (uint32_t i = 0; i < cnt; ++i) {
+		const int   p = rnd (seed) % 3;
+		const float r = hi[p] - lo[p];
+		const float v = rnd (seed) % 16 ? rndf (seed, lo[p] - r, hi[p] + r) : NAN;
+		h->send_set (prop[p], v, rnd (seed) % n);
+	}
+}
+
+/* change one control, or send a message */
+static void
+tweak (LV2Host* h, uint32_t* seed)
+{
+	switch (rnd (seed) % 8) {
+		case 0:
+			h->ctl[PLIM_ENABLE] = h->ctl[PLIM_ENABLE] > 0 ? 0 : 1;
+			break;
+		case 1:
+			h->ctl[PLIM_TRUEPEAK] = h->ctl[PLIM_TRUEPEAK] > 0 ? 0 : 1;
+			break;
+		case 2:
+			h->ctl[PLIM_GAIN] = rndf (seed, -10, 30);
+			break;
+		case 3:
+			h->ctl[PLIM_THRESHOLD] = rndf (seed, -10, 0);
+			break;
+		case 4:
+			h->ctl[PLIM_RELEASE] = rndf (seed, 0.001, 1);
+			break;
+		case 5:
+			h->ctl[PLIM_LOOKAHEAD] = rndf (seed, 0.25, 10);
+			break;
+		case 6:
+			h->send (h->uris.ui_off);
+			h->send (h->uris.ui_on);
+			break;
+		case 7:
+			h->send (h->uris.ui_off);
+			break;
+	}
+}
+
+static float
+percentile (const float* sorted, uint32_t n, double p)
+{
+	uint32_t i = ceil (p * n) - 1;
+	return sorted[i < n ? i : n - 1];
+}
+
+static void
+usage (int status)
+{
+	printf ("dpl-wcet - Worst-case execution time of dpl.lv2 run ().\n\n");
+	printf ("Usage: dpl-wcet [ OPTIONS ] [ <plugin.so> ]\n\n");
+	printf ("Options:\n"
+	        " -c, --variant <name>     mono, stereo, ch4, ch6, ch8, ch16 (default: stereo)\n"
+	        " -r, --rate <Hz>          sample-rate (default: 48000)\n"
+	        " -b, --blocksize <num>    samples per call (default: 64)\n"
+	        " -V, --variable           random block sizes 1..blocksize\n"
+	        " -n, --calls <num>        number of calls (default: 1000000)\n"
+	        " -B, --budget <usec>      maximum allowed time per call\n"
+	        "                          (default: the duration of a block)\n"
+	        " -s, --seed <num>         random seed (default: 1)\n"
+	        " -h, --help               display this help and exit\n"
+	        "\n");
+	printf ("The plugin (default: build/dpl.so) is loaded, and run () is called with\n"
+	        "varying input signals while controls are changed, the GUI is shown and\n"
+	        "hidden, and with sample-accurate automation (patch:Set, several per call\n"
+	        "and out of range) in every 16th call. The time of each call is measured,\n"
+	        "and the distribution is reported. The exit status is non-zero if a call\n"
+	        "exceeds the budget.\n");
+	exit (status);
+}
+
+static struct option const long_options[] = {
+	{ "variant", required_argument, 0, 'c' },
+	{ "rate", required_argument, 0, 'r' },
+	{ "blocksize", required_argument, 0, 'b' },
+	{ "variable", no_argument, 0, 'V' },
+	{ "calls", required_argument, 0, 'n' },
+	{ "budget", required_argument, 0, 'B' },
+	{ "seed", required_argument, 0, 's' },
+	{ "help", no_argument, 0, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+int
+main (int argc, char** argv)
+{
+	const char* variant  = "stereo";
+	int         rate     = 48000;
+	uint32_t    bs       = 64;
+	bool        variable = false;
+	uint32_t    ncalls   = 1000000;
+	double      budget   = 0;
+	uint32_t    seed     = 1;
+
+	int c;
+	while ((c = getopt_long (argc, argv,
+	                         "c:" /* variant */
+	                         "r:" /* rate */
+	                         "b:" /* blocksize */
+	                         "V"  /* variable */
+	                         "n:" /* calls */
+	                         "B:" /* budget */
+	                         "s:" /* seed */
+	                         "h", /* help */
+	                         long_options, (int*)0)) != EOF) {
+		switch (c) {
+			case 'c':
+				variant = optarg;
+				break;
+			case 'r':
+				rate = atoi (optarg);
+				break;
+			case 'b':
+				bs = atoi (optarg);
+				break;
+			case 'V':
+				variable = true;
+				break;
+			case 'n':
+				ncalls = atoi (optarg);
+				break;
+			case 'B':
+				budget = atof (optarg);
+				break;
+			case 's':
+				seed = atoi (optarg);
+				break;
+			case 'h':
+				usage (EXIT_SUCCESS);
+				break;
+			default:
+				usage (EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if (rate < 8000 || bs < 1 || bs > 65536 || ncalls < 1 || optind + 1 < argc) {
+		usage (EXIT_FAILURE);
+	}
+	if (budget <= 0) {
+		budget = 1e6 * bs / rate;
+	}
+
+	const char* path = optind < argc ? argv[optind] : "build/dpl.so";
+
+	LV2Host host;
+	if (!host.load (path, variant, rate, bs)) {
+		fprintf (stderr, "Cannot load '%s': %s\n", path, host.error ());
+		return EXIT_FAILURE;
+	}
+
+	Stats st;
+	st.n    = ncalls;
+	st.t    = (float*)calloc (ncalls, sizeof (float));
+	st.stim = (uint8_t*)calloc (ncalls, 1);
+
+	/* avoid page-faults and preemption, if permitted */
+	mlockall (MCL_CURRENT | MCL_FUTURE);
+
+	struct sched_param sp;
+	sp.sched_priority = sched_get_priority_max (SCHED_FIFO) - 1;
+	if (pthread_setschedparam (pthread_self (), SCHED_FIFO, &sp)) {
+		fprintf (stderr, "Note: no realtime scheduling, the maximum includes preemption.\n");
+	}
+
+	host.send (host.uris.ui_on);
+
+	int      stim = STIM_SILENCE;
+	uint64_t pos  = 0;
+	uint32_t imax = 0;
+
+	for (uint32_t i = 0; i < ncalls; ++i) {
+		if (i % 4096 == 0) {
+			stim = rnd (&seed) % STIM_LAST;
+		}
+		const uint32_t n = variable ? 1 + rnd (&seed) % bs : bs;
+
+		if (rnd (&seed) % 512 == 0) {
+			tweak (&host, &seed);
+		}
+		if (rnd (&seed) % 16 == 0) {
+			automate (&host, &seed, n);
+		}
+		for (uint32_t ch = 0; ch < host.nchan; ++ch) {
+			generate (host.ins[ch], n, stim, pos, rate, &seed);
+		}
+		pos += n;
+
+		host.prepare ();
+		const double t0 = walltime ();
+		host.desc->run (host.handle, n);
+		const double t1 = walltime ();
+
+		st.t[i]    = 1e6 * (t1 - t0);
+		st.stim[i] = stim;
+		if (st.t[i] > st.t[imax]) {
+			imax = i;
+		}
+	}
+
+	printf ("%s, %d Hz, %s%u samples per call, %u calls\n", variant, rate, variable ? "1.." : "", bs, ncalls);
+	printf ("%-10s %9s %9s %9s %9s %9s\n", "usec", "p50", "p99", "p99.9", "max", "calls");
+
+	/* per stimulus, then all calls */
+	float* sorted = (float*)malloc (ncalls * sizeof (float));
+	for (int s = 0; s <= STIM_LAST; ++s) {
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < ncalls; ++i) {
+			if (s == STIM_LAST || st.stim[i] == s) {
+				sorted[n++] = st.t[i];
+			}
+		}
+		if (n == 0) {
+			continue;
+		}
+		sort (sorted, sorted + n);
+		printf ("%-10s %9.2f %9.2f %9.2f %9.2f %9u\n", s == STIM_LAST ? "all" : stim_names[s],
+		        percentile (sorted, n, .5), percentile (sorted, n, .99), percentile (sorted, n, .999), sorted[n - 1], n);
+	}
+
+	const bool ok = st.t[imax] <= budget;
+	printf ("max: %.2f usec at call %u (%s), budget %.2f usec: %s\n",
+	        st.t[imax], imax, stim_names[st.stim[imax]], budget, ok ? "OK" : "EXCEEDED");
+
+	free (sorted);
+	free (st.t);
+	free (st.stim);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}